@@ -0,0 +1,25 @@
+find_path(
+	LZ4_INCLUDE_DIR
+	NAMES lz4.h
+	HINTS
+	PATH_SUFFIXES include
+	PATHS
+	/usr/local
+	/usr
+	/opt/local
+)
+
+find_library(
+	LZ4_LIBRARIES
+	NAMES lz4
+	HINTS
+	PATH_SUFFIXES lib64 lib
+	PATHS
+	/usr/local
+	/usr
+	/opt/local
+)
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(LZ4 DEFAULT_MSG LZ4_LIBRARIES LZ4_INCLUDE_DIR)
+mark_as_advanced(LZ4_INCLUDE_DIR LZ4_LIBRARIES)
@@ -231,6 +231,16 @@ vole_check_package(GDAL
         "${GDAL_LIBRARIES}"
 )
 
+# LZ4 (chunk compression of native cube files)
+find_package(LZ4)
+vole_check_package(LZ4
+	"LZ4"
+	"Please install LZ4"
+	LZ4_FOUND
+	"${LZ4_INCLUDE_DIR}"
+	"${LZ4_LIBRARIES}"
+)
+
 #OpenCL
 #find_package(OpenCL)
 #vole_check_package(OpenCL
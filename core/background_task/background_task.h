@@ -11,6 +11,7 @@
 
 #ifdef WITH_BOOST_THREAD
 #include <string>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
@@ -22,11 +23,16 @@
 #endif
 
 /** Abstract class for background tasks. Tasks are expected to be queued into
-    BackgroundTaskQueue by which they are dispatched one-by-one. Inheritors
+    BackgroundTaskQueue by which they are dispatched. Inheritors
 	shall implement run() and cancel() functions which are specific to the
 	actual algorithm and technology. Algorithm executed in run() function can
 	optionally report progress via update() function. Task creator can wait 
-	for completion either synchronously or asynchronously. */
+	for completion either synchronously or asynchronously.
+
+	Tasks declare the shared data they read and write via reads() and writes().
+	The queue runs tasks concurrently unless their data overlaps. Tasks that
+	do not declare any data act as a barrier: they run after all tasks queued
+	before them and before all tasks queued after them. */
 #ifdef WITH_QT
 class BackgroundTask : public QObject {
 	Q_OBJECT
@@ -35,10 +41,30 @@ class BackgroundTask {
 #endif
 
 public:
+	/** Scheduling priority among tasks that are ready to run. */
+	enum Priority {
+		/** Bulk recomputation, e.g. of image representations. */
+		PRIORITY_BULK = 0,
+		/** Results the user is actively waiting for. */
+		PRIORITY_INTERACTIVE = 1
+	};
+
 	BackgroundTask()
-		: terminated(false), success(false) {}
+		: terminated(false), success(false), priority(PRIORITY_BULK) {}
 	virtual ~BackgroundTask() {}
 
+	/** Declare data read by the task, e.g. a SharedMultiImgPtr. */
+	template<class T>
+	void reads(const boost::shared_ptr<T> &data) { inputs.push_back(data.get()); }
+	/** Declare data written (or replaced) by the task. */
+	template<class T>
+	void writes(const boost::shared_ptr<T> &data) { outputs.push_back(data.get()); }
+	const std::vector<const void*> &getInputs() const { return inputs; }
+	const std::vector<const void*> &getOutputs() const { return outputs; }
+
+	Priority getPriority() const { return priority; }
+	void setPriority(Priority p) { priority = p; }
+
 	/** Task-specific algorithm implemented in the inheritor. It depends
 	    on the actual implementation what technologies and what amount
 		of parallelism is used for the calculation. */
@@ -78,6 +104,10 @@ protected:
 	bool success;
 	/** Short description of task for GUI progress updates. */
 	std::string description; 
+	/** Identity of shared data read and written by the task. */
+	std::vector<const void*> inputs, outputs;
+	/** Scheduling priority. */
+	Priority priority;
 };
 
 typedef boost::shared_ptr<BackgroundTask> BackgroundTaskPtr;
@@ -11,64 +11,153 @@
 //#define BACKGROUND_TASK_QUEUE_DEBUG
 
 #include "background_task_queue.h"
+#include <tbb/task_scheduler_init.h>
+#include <algorithm>
 #include <iostream>
 #include <iomanip>
 
+class BackgroundTaskQueue::Runner {
+public:
+	Runner(BackgroundTaskQueue &queue, const NodePtr &node)
+		: queue(queue), node(node) {}
+
+	void operator()() const
+	{
+		bool success = false;
+		try {
+			success = node->task->run();
+		} catch (...) {
+			Lock lock(queue.mutex);
+			if (!queue.failure)
+				queue.failure = std::current_exception();
+		}
+		queue.finish(node, success);
+	}
+
+private:
+	BackgroundTaskQueue &queue;
+	NodePtr node;
+};
+
+BackgroundTaskQueue::BackgroundTaskQueue()
+	: halted(false), running(0), seq(0)
+{
+	// leave room for the calculations within the tasks
+	maxRunning = std::max(2, tbb::task_scheduler_init::default_num_threads() / 2);
+}
+
 bool BackgroundTaskQueue::isIdle()
 {
 	Lock lock(mutex);
-	return (taskQueue.empty()) && (!currentTask);
+	return tasks.empty();
 }
 
 void BackgroundTaskQueue::halt()
 {
 	Lock lock(mutex);
 	halted = true;
-	taskQueue.clear(); // Flush the queue, so there is nothing else to pop.
-	if (currentTask) {
-		cancelled = true;
-		currentTask->cancel();
-	}
+	// Flush the queue, so there is nothing else to pop.
+	for (size_t i = 0; i < tasks.size(); ++i)
+		cancelNode(tasks[i]);
 	lock.unlock(); // Unlock to prevent deadlock when signalling the condition.
 	future.notify_all(); // In case the thread is sleeping.
 }
 
-bool BackgroundTaskQueue::pop() 
+bool BackgroundTaskQueue::conflicts(const BackgroundTask &a,
+                                    const BackgroundTask &b)
+{
+	const std::vector<const void*> &ain = a.getInputs(), &aout = a.getOutputs();
+	const std::vector<const void*> &bin = b.getInputs(), &bout = b.getOutputs();
+	// tasks without declared data are barriers
+	if ((ain.empty() && aout.empty()) || (bin.empty() && bout.empty()))
+		return true;
+	for (size_t i = 0; i < aout.size(); ++i) {
+		if (std::find(bin.begin(), bin.end(), aout[i]) != bin.end() ||
+			std::find(bout.begin(), bout.end(), aout[i]) != bout.end())
+			return true;
+	}
+	for (size_t i = 0; i < ain.size(); ++i) {
+		if (std::find(bout.begin(), bout.end(), ain[i]) != bout.end())
+			return true;
+	}
+	return false;
+}
+
+BackgroundTaskQueue::NodePtr BackgroundTaskQueue::pop()
 {
 	Lock lock(mutex);
-	while (taskQueue.empty()) {
-		if (halted) {
-			return false; // Thread will terminate.
-		} else {
-			future.wait(lock); // Yields lock until signalled.
+	while (true) {
+		if (failure) {
+			std::exception_ptr e = failure;
+			failure = std::exception_ptr();
+			std::rethrow_exception(e);
 		}
-	}
-	currentTask = taskQueue.front(); // Fetch the task.
-	taskQueue.pop_front();
+		if (halted && tasks.empty())
+			return NodePtr(); // Thread will terminate.
+
+		// highest priority first, then in order of push()
+		NodePtr best;
+		for (size_t i = 0; i < tasks.size(); ++i) {
+			const NodePtr &n = tasks[i];
+			if (n->running || n->pending > 0)
+				continue;
+			if (n->cancelled) { // will not run, so does not count
+				best = n;
+				break;
+			}
+			if (running >= maxRunning)
+				continue;
+			if (!best || n->task->getPriority() > best->task->getPriority())
+				best = n;
+		}
+		if (best) {
+			best->running = true;
+			++running;
 #ifdef BACKGROUND_TASK_QUEUE_DEBUG
-	std::cout << "BackgroundTaskQueue pop():" << std::endl;
-	print();
+			std::cout << "BackgroundTaskQueue pop():" << std::endl;
+			print();
 #endif /* BACKGROUND_TASK_QUEUE_DEBUG */
-	cancelled = false;
-	return true;
+			return best;
+		}
+		future.wait(lock); // Yields lock until signalled.
+	}
+}
+
+void BackgroundTaskQueue::finish(const NodePtr &node, bool success)
+{
+	Lock lock(mutex);
+	node->task->done(!node->cancelled && success);
+	for (size_t i = 0; i < node->successors.size(); ++i)
+		--node->successors[i]->pending;
+	tasks.erase(std::find(tasks.begin(), tasks.end(), node));
+	--running;
+	lock.unlock(); // Unlock to prevent deadlock when signalling the condition.
+	future.notify_all();
 }
 
 void BackgroundTaskQueue::print()
 {
-	int row = 0;
-	for(std::deque<BackgroundTaskPtr>::const_iterator it = taskQueue.begin();
-		it != taskQueue.end();
-		++it, ++row)
-	{
-		std::string name = typeid(**it).name();
-		std::cout << std::setw(4) << row << " " << name << std::endl;
+	for (size_t row = 0; row < tasks.size(); ++row) {
+		const Node &n = *tasks[row];
+		std::string name = typeid(*n.task).name();
+		std::cout << std::setw(4) << row << " " << name
+		          << (n.running ? " running" : "")
+		          << " pending " << n.pending
+		          << " priority " << n.task->getPriority() << std::endl;
 	}
 }
 
 void BackgroundTaskQueue::push(BackgroundTaskPtr &task) 
 {
 	Lock lock(mutex);
-	taskQueue.push_back(task);
+	NodePtr node(new Node(task, seq++));
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		if (conflicts(*tasks[i]->task, *task)) {
+			tasks[i]->successors.push_back(node);
+			++node->pending;
+		}
+	}
+	tasks.push_back(node);
 #ifdef BACKGROUND_TASK_QUEUE_DEBUG
 	std::cout << "BackgroundTaskQueue push():" << std::endl;
 	print();
@@ -77,14 +166,41 @@ void BackgroundTaskQueue::push(BackgroundTaskPtr &task)
 	future.notify_all();
 }
 
-void BackgroundTaskQueue::cancelTasks()
+int BackgroundTaskQueue::cancelNode(const NodePtr &node)
+{
+	if (node->cancelled)
+		return 0;
+	int ret = 1;
+	node->cancelled = true;
+	if (node->running)
+		node->task->cancel();
+	// depending tasks would work on stale data
+	for (size_t i = 0; i < node->successors.size(); ++i)
+		ret += cancelNode(node->successors[i]);
+	return ret;
+}
+
+int BackgroundTaskQueue::cancelWriters(const void *data)
 {
 	Lock lock(mutex);
-	taskQueue.clear();
-	if (currentTask) {
-		cancelled = true;
-		currentTask->cancel();
+	int ret = 0;
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		const std::vector<const void*> &out = tasks[i]->task->getOutputs();
+		if (std::find(out.begin(), out.end(), data) != out.end())
+			ret += cancelNode(tasks[i]);
 	}
+	lock.unlock();
+	future.notify_all();
+	return ret;
+}
+
+void BackgroundTaskQueue::cancelTasks()
+{
+	Lock lock(mutex);
+	for (size_t i = 0; i < tasks.size(); ++i)
+		cancelNode(tasks[i]);
+	lock.unlock();
+	future.notify_all();
 }
 
 void BackgroundTaskQueue::operator()() 
@@ -95,18 +211,21 @@ void BackgroundTaskQueue::operator()()
 	{
 #endif
 		while (true) {
-			if (!pop()) {
+			NodePtr node = pop();
+			if (!node) {
 				break; // Thread termination.
 			}
-			bool success = currentTask->run();
-			{
-				Lock lock(mutex);
-				currentTask->done(!cancelled && success);
-				currentTask.reset();
+			if (node->cancelled) {
+				// report completion without running the task
+				finish(node, false);
+				continue;
 			}
+			group.run(Runner(*this, node));
 		}
+		group.wait();
 #ifdef WITH_QT
 	} catch (std::exception &) {
+		group.wait();
 		emit exception(std::current_exception(), true);
 #endif
 	}
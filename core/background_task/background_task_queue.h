@@ -10,17 +10,30 @@
 #define BACKGROUND_TASK_QUEUE_H
 
 #ifdef WITH_BOOST_THREAD
-#include <deque>
+#include <vector>
+#include <exception>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <opencv2/core/core.hpp>
+#include <tbb/task_group.h>
 #include "background_task.h"
 #ifdef WITH_QT
 #include <QObject>
-#include <exception>
 #endif
 
+/** Dependency-aware scheduler for background tasks.
+
+	On push(), a task becomes dependent on all queued or running tasks that
+	write data it reads or writes, or that read data it writes (see
+	BackgroundTask::reads() and BackgroundTask::writes()). The worker thread
+	dispatches tasks without unfinished dependencies to the TBB pool, so
+	independent tasks run concurrently. Among ready tasks, higher priority
+	comes first, then the order of push().
+
+	cancelTasks(data) aborts only the tasks writing the given data and all
+	tasks depending on them, all other tasks continue. Cancelled tasks report
+	completion with success == false. */
 #ifdef WITH_QT
 class BackgroundTaskQueue : public QObject {
 	Q_OBJECT
@@ -29,7 +42,7 @@ class BackgroundTaskQueue {
 #endif
 
 public:
-	BackgroundTaskQueue() : halted(false), cancelled(false) {}
+	BackgroundTaskQueue();
 
 	/** Any tasks in the queue? */
 	bool isIdle();
@@ -40,6 +53,13 @@ public:
 	void push(BackgroundTaskPtr &task);
 	/** Cancel all tasks. */
 	void cancelTasks();
+	/** Cancel tasks writing data and all tasks depending on them.
+	 *
+	 * @return number of cancelled tasks
+	 */
+	template<class T>
+	int cancelTasks(const boost::shared_ptr<T> &data)
+	{ return cancelWriters(data.get()); }
 
 	/** Background worker thread's main(). */
 	void operator()(); 
@@ -50,8 +70,41 @@ signals:
 #endif
 
 protected:
-	/** Fetch task from queue or passivelly wait on empty queue. */
-	bool pop();
+	struct Node;
+	typedef boost::shared_ptr<Node> NodePtr;
+	/** Task in the dependency graph. */
+	struct Node {
+		Node(BackgroundTaskPtr task, unsigned long seq)
+			: task(task), seq(seq), pending(0),
+			  running(false), cancelled(false) {}
+		BackgroundTaskPtr task;
+		/** Order of push(). */
+		unsigned long seq;
+		/** Number of unfinished tasks we depend on. */
+		int pending;
+		/** Tasks depending on us. */
+		std::vector<NodePtr> successors;
+		bool running;
+		/** Discard results of the task. */
+		bool cancelled;
+	};
+
+	/** Functor running a task on the TBB pool. */
+	class Runner;
+	friend class Runner;
+
+	/** Fetch ready task or passivelly wait until there is one. */
+	NodePtr pop();
+	/** Report completion of task and release tasks depending on it. */
+	void finish(const NodePtr &node, bool success);
+	/** Mark task and all tasks depending on it cancelled.
+	 *
+	 * Locking the queue mutex is responsibility of the caller.
+	 */
+	int cancelNode(const NodePtr &node);
+	int cancelWriters(const void *data);
+	/** Do tasks need to be ordered because of their data? */
+	static bool conflicts(const BackgroundTask &a, const BackgroundTask &b);
 
 	/** Print queue content to stdout. 
 	 *
@@ -70,16 +123,22 @@ private:
 
 	/** Used for background thread termination. */
 	bool halted; 
-	/** Discards results of the currently calculated task. */
-	bool cancelled; 
 	/** Wakes sleeping worker thread. */
 	boost::condition_variable future; 
 	/** Serializes thread access to the queue. */
 	Mutex mutex;
-	/** Currently calculated task. */
-	BackgroundTaskPtr currentTask; 
-	/** Task queue which is consumed one-by-one by worker thread. */
-	std::deque<BackgroundTaskPtr> taskQueue;
+	/** Unfinished tasks (queued and running) in order of push(). */
+	std::vector<NodePtr> tasks;
+	/** Number of tasks currently running. */
+	int running;
+	/** Maximum number of tasks running concurrently. */
+	int maxRunning;
+	/** Counter for Node::seq. */
+	unsigned long seq;
+	/** Exception thrown by a task, rethrown in worker thread. */
+	std::exception_ptr failure;
+	/** Tasks dispatched to the TBB pool. */
+	tbb::task_group group;
 };
 
 #endif
@@ -47,7 +47,8 @@ bool IlluminantCuda::run()
 
 	if (includecache) {
 		RebuildPixels rebuildPixels(*target);
-		tbb::parallel_for(tbb::blocked_range<size_t>(0, target->size()),
+		tbb::parallel_for(tbb::blocked_range2d<int>(0, target->height,
+		                                            0, target->width),
 			rebuildPixels, tbb::auto_partitioner(), stopper);
 		target->dirty.setTo(0);
 		target->anydirt = false;
@@ -22,11 +22,12 @@ bool PcaTbb::run()
 	multi_img *target = new multi_img(
 		(*source)->height, (*source)->width, pca.eigenvectors.rows);
 	PcaProjection computeProjection(pixels, *target, pca);
-	tbb::parallel_for(tbb::blocked_range<size_t>(0, target->pixels.size()),
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, target->pixels.rows),
 		computeProjection, tbb::auto_partitioner(), stopper);
 
 	ApplyCache applyCache(*target);
-	tbb::parallel_for(tbb::blocked_range<size_t>(0, target->size()),
+	tbb::parallel_for(tbb::blocked_range2d<int>(0, target->height,
+	                                            0, target->width),
 		applyCache, tbb::auto_partitioner(), stopper);
 
 	DetermineRange determineRange(*target);
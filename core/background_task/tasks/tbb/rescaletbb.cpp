@@ -17,7 +17,8 @@ bool RescaleTbb::run()
 		cv::Rect(0, 0, (*source)->width, (*source)->height));
 	temp->roi = (*source)->roi;
 	RebuildPixels rebuildPixels(*temp);
-	tbb::parallel_for(tbb::blocked_range<size_t>(0, temp->size()),
+	tbb::parallel_for(tbb::blocked_range2d<int>(0, temp->height,
+	                                            0, temp->width),
 		rebuildPixels, tbb::auto_partitioner(), stopper);
 	temp->dirty.setTo(0);
 	temp->anydirt = false;
@@ -35,7 +36,8 @@ bool RescaleTbb::run()
 			computeResize, tbb::auto_partitioner(), stopper);
 
 		ApplyCache applyCache(*target);
-		tbb::parallel_for(tbb::blocked_range<size_t>(0, target->size()),
+		tbb::parallel_for(tbb::blocked_range2d<int>(0, target->height,
+		                                            0, target->width),
 			applyCache, tbb::auto_partitioner(), stopper);
 		target->dirty.setTo(0);
 		target->anydirt = false;
@@ -0,0 +1,127 @@
+/*
+	Copyright(c) 2012 Johannes Jordan <johannes.jordan@cs.fau.de>.
+
+	This file may be licensed under the terms of of the GNU General Public
+	License, version 3, as published by the Free Software Foundation. You can
+	find it here: http://www.gnu.org/licenses/gpl.html
+*/
+
+/* Micro-benchmark for the conversion between band planes and the
+   interleaved pixel cache of multi_img.
+
+   Usage: bench_transpose [repetitions]
+
+   Reports throughput in GB/s (bytes read + bytes written) for each
+   instruction set on a single thread, and for the TBB-parallel
+   RebuildPixels / ApplyCache functors as used by the background tasks. */
+
+#include <multi_img.h>
+#include <multi_img/multi_img_tbb.h>
+#include <multi_img/transpose.h>
+#include <stopwatch.h>
+
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range2d.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <vector>
+
+static const int WIDTH = 512;
+// floats per representation, keeps the working set well above LLC size
+static const size_t VOLUME = 16 << 20;
+
+static double gbps(size_t floats, double seconds)
+{
+	return (2. * floats * sizeof(float)) / seconds / 1e9;
+}
+
+static void benchKernels(multi_img &img, int reps)
+{
+	const size_t nbands = img.size();
+	std::vector<const float*> src(nbands);
+	std::vector<float*> dst(nbands);
+	std::vector<multi_img::Band> planes(nbands);
+	for (size_t d = 0; d < nbands; ++d)
+		planes[d] = multi_img::Band(img.height, img.width);
+	cv::Mat1f pixels(img.height * img.width, (int)nbands);
+	const size_t floats = pixels.total();
+
+	const transpose::Isa best = transpose::detectIsa();
+	for (int i = transpose::ISA_SCALAR; i <= best; ++i) {
+		transpose::Isa isa = (transpose::Isa)i;
+
+		Stopwatch watch;
+		for (int r = 0; r < reps; ++r) {
+			for (int y = 0; y < img.height; ++y) {
+				for (size_t d = 0; d < nbands; ++d)
+					src[d] = img[d][y];
+				transpose::bandsToPixels(&src[0], nbands, img.width,
+				                         pixels[y*img.width], nbands, isa);
+			}
+		}
+		double b2p = watch.measure() / reps;
+
+		watch.reset();
+		for (int r = 0; r < reps; ++r) {
+			for (int y = 0; y < img.height; ++y) {
+				for (size_t d = 0; d < nbands; ++d)
+					dst[d] = planes[d][y];
+				transpose::pixelsToBands(pixels[y*img.width], nbands, nbands,
+				                         img.width, &dst[0], isa);
+			}
+		}
+		double p2b = watch.measure() / reps;
+
+		std::printf("%5d bands  %-8s 1 thread   band->pixel %7.2f GB/s   "
+		            "pixel->band %7.2f GB/s\n", (int)nbands,
+		            transpose::isaName(isa), gbps(floats, b2p),
+		            gbps(floats, p2b));
+	}
+}
+
+static void benchFunctors(multi_img &img, int reps)
+{
+	const size_t floats = (size_t)img.height * img.width * img.size();
+	tbb::blocked_range2d<int> range(0, img.height, 0, img.width);
+
+	Stopwatch watch;
+	for (int r = 0; r < reps; ++r)
+		tbb::parallel_for(range, RebuildPixels(img));
+	double b2p = watch.measure() / reps;
+
+	watch.reset();
+	for (int r = 0; r < reps; ++r)
+		tbb::parallel_for(range, ApplyCache(img));
+	double p2b = watch.measure() / reps;
+
+	std::printf("%5d bands  %-8s TBB        band->pixel %7.2f GB/s   "
+	            "pixel->band %7.2f GB/s\n", (int)img.size(),
+	            transpose::isaName(transpose::ISA_AUTO), gbps(floats, b2p),
+	            gbps(floats, p2b));
+}
+
+int main(int argc, char **argv)
+{
+	int reps = (argc > 1 ? std::atoi(argv[1]) : 5);
+	if (reps < 1)
+		reps = 1;
+
+	const int bandcounts[] = { 3, 8, 31, 64, 128, 256 };
+	for (size_t i = 0; i < sizeof(bandcounts)/sizeof(int); ++i) {
+		const int nbands = bandcounts[i];
+		const int height = std::max<int>(1, VOLUME / (WIDTH * nbands));
+
+		multi_img img(height, WIDTH, nbands);
+		for (int d = 0; d < nbands; ++d) {
+			multi_img::Band band(height, WIDTH);
+			cv::randu(band, 0.f, 255.f);
+			img.setBand(d, band);
+		}
+
+		benchKernels(img, reps);
+		benchFunctors(img, reps);
+	}
+	return 0;
+}
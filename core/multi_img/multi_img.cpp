@@ -7,6 +7,7 @@
 */
 
 #include "multi_img.h"
+#include "transpose.h"
 #ifdef WITH_OPENCV2 // theoretically, vole could be built w/o opencv..
 #include <iostream>
 #include <string>
@@ -74,7 +75,7 @@ multi_img & multi_img::operator=(const multi_img &a) {
 			bands[i] = a.bands[i].clone();
 
 		// cache data
-		pixels = a.pixels;
+		pixels = a.pixels.clone();
 		dirty = a.dirty.clone();
 		anydirt = a.anydirt;
 	}
@@ -91,7 +92,7 @@ multi_img::multi_img(const multi_img &a, bool omitCache)
 	if (omitCache) {
 		resetPixels();
 	} else {
-		pixels = a.pixels;
+		pixels = a.pixels.clone();
 		dirty = a.dirty.clone();
 		anydirt = a.anydirt;
 	}
@@ -133,9 +134,10 @@ multi_img::multi_img(const multi_img &a, unsigned int start, unsigned int end) :
 
 void multi_img::resetPixels(bool force) const
 {
-	if (force || pixels.empty()) {
-		pixels.assign(width * height, Pixel(size()));
-	}
+	if (force)
+		pixels.release();
+	// only allocates if geometry changed; one continuous block
+	pixels.create(width * height, (int)size());
 	if (force || dirty.empty())
 		dirty = cv::Mat1b(height, width, 255);
 	else
@@ -149,13 +151,7 @@ void multi_img::rebuildPixels(bool optimistic) const
 		return;
 
 	std::cerr << "multi_img: complete rebuild" << std::endl;
-	Band::const_iterator it;
-	register unsigned int d, i;
-	for (d = 0; d < size(); ++d) {
-		const Band &src = bands[d];
-		for (it = src.begin(), i = 0; it != src.end(); ++it, ++i)
-			pixels[i][d] = *it;
-	}
+	bandsToPixels(cv::Rect(0, 0, width, height), 0, size());
 	dirty.setTo(0);
 	anydirt = false;
 }
@@ -163,25 +159,25 @@ void multi_img::rebuildPixels(bool optimistic) const
 void multi_img::rebuildPixel(unsigned int row, unsigned int col) const
 {
 	std::cerr << "multi_img: rebuild pixel " << row << "." << col << std::endl;
-	Pixel &p = pixels[row*width + col];
+	Value *p = pixels[row*width + col];
 	for (size_t i = 0; i < size(); ++i)
 		p[i] = bands[i](row, col);
 
 	dirty(row, col) = 0;
 }
 
-std::vector<const multi_img::Pixel*> multi_img::getSegment(const cv::Mat1b &mask)
+std::vector<multi_img::PixelView> multi_img::getSegment(const cv::Mat1b &mask)
 {
 	assert(mask.rows == height && mask.cols == width);
 
-	std::vector<const Pixel*> ret;
+	std::vector<PixelView> ret;
 	for (int row = 0; row < height; ++row) {
 		const uchar *m = mask[row];
 		for (int col = 0; col < width; ++col) {
 			if (m[col] > 0) {
 				if (anydirt && dirty(row, col))
 					rebuildPixel(row, col);
-				ret.push_back(&pixels[row*width + col]);
+				ret.push_back(PixelView(pixels[row*width + col], size()));
 			}
 		}
 	}
@@ -199,7 +195,8 @@ std::vector<multi_img::Pixel> multi_img::getSegmentCopy(const cv::Mat1b &mask)
 			if (m[col] > 0) {
 				if (anydirt && dirty(row, col))
 					rebuildPixel(row, col);
-				ret.push_back(pixels[row*width + col]);
+				ret.push_back(Pixel(pixels[row*width + col],
+				                    pixels[row*width + col] + size()));
 			}
 		}
 	}
@@ -211,10 +208,9 @@ void multi_img::setPixel(unsigned int row, unsigned int col,
 {
 	assert((int)row < height && (int)col < width);
 	assert(values.size() == size());
-	Pixel &p = pixels[row*width + col];
-	p = values;
+	Value *p = pixels[row*width + col];
 	for (size_t i = 0; i < size(); ++i)
-		bands[i](row, col) = p[i];
+		bands[i](row, col) = p[i] = values[i];
 
 	dirty(row, col) = 0;
 }
@@ -225,8 +221,8 @@ void multi_img::setPixel(unsigned int row, unsigned int col,
 {
 	assert((int)row < height && (int)col < width);
 	assert(values.rows*values.cols == (int)size());
-	Pixel &p = pixels[row*width + col];
-	p.assign(values.begin(), values.end());
+	Value *p = pixels[row*width + col];
+	std::copy(values.begin(), values.end(), p);
 
 	for (size_t i = 0; i < size(); ++i)
 		bands[i](row, col) = p[i];
@@ -302,18 +298,45 @@ void multi_img::setTo(const Pixel &p)
 
 void multi_img::applyCache()
 {
-	for (unsigned int d = 0; d < size(); ++d) {
-		Band &dst = bands[d];
-		Band::iterator it;
-		unsigned int i;
-		for (it = dst.begin(), i = 0; it != dst.end(); it++, i++)
-			*it = pixels[i][d];
-	}
+	pixelsToBands(cv::Rect(0, 0, width, height), 0, size());
 	// cache data is now consistent with band data
 	dirty.setTo(0);
 	anydirt = false;
 }
 
+/* Both directions are done row by row with the SIMD tile kernels of
+   transpose.h, so the written lines stay in cache while the read lines are
+   streamed. */
+void multi_img::bandsToPixels(const cv::Rect &region,
+                              size_t first, size_t last) const
+{
+	if (first >= last || region.width <= 0)
+		return;
+	std::vector<const Value*> src(last - first);
+	for (int row = region.y; row < region.br().y; ++row) {
+		for (size_t d = first; d < last; ++d)
+			src[d - first] = bands[d][row] + region.x;
+		Value *dst = pixels[row*width + region.x] + first;
+		transpose::bandsToPixels(&src[0], last - first, region.width,
+		                         dst, size());
+	}
+}
+
+void multi_img::pixelsToBands(const cv::Rect &region,
+                              size_t first, size_t last)
+{
+	if (first >= last || region.width <= 0)
+		return;
+	std::vector<Value*> dst(last - first);
+	for (int row = region.y; row < region.br().y; ++row) {
+		for (size_t d = first; d < last; ++d)
+			dst[d - first] = bands[d][row] + region.x;
+		const Value *src = pixels[row*width + region.x] + first;
+		transpose::pixelsToBands(src, size(), last - first, region.width,
+		                         &dst[0]);
+	}
+}
+
 multi_img::Range multi_img::data_range(double fraction) const
 {
 	assert(!empty());
@@ -380,13 +403,9 @@ cv::PCA multi_img::pca(unsigned int components) const
 	// make sure cache is there
 	rebuildPixels(true);
 
-	// create input matrix
-	cv::Mat_<Value> input(size(), (int)pixels.size());
-	for (size_t i = 0; i < pixels.size(); ++i) {
-		cv::Mat_<Value> in(pixels[i]);
-		cv::Mat_<Value> out(input.col((int)i));
-		in.copyTo(out);
-	}
+	// create input matrix (one column per pixel)
+	cv::Mat_<Value> input;
+	cv::transpose(pixels, input);
 
 	// perform PCA
 	cv::PCA ret(input, cv::noArray(), CV_PCA_DATA_AS_COL, (int)components);
@@ -400,10 +419,10 @@ multi_img multi_img::project(const cv::PCA &pca) const
 	// make sure input cache is there
 	rebuildPixels(true);
 
-	// write
-	for (size_t i = 0; i < ret.pixels.size(); ++i) {
-		cv::Mat_<Value> input(pixels[i]);
-		cv::Mat_<Value> output(ret.pixels[i]);
+	// write (column vector headers over the pixel cache)
+	for (int i = 0; i < ret.pixels.rows; ++i) {
+		cv::Mat_<Value> input((int)size(), 1, pixels[i]);
+		cv::Mat_<Value> output((int)ret.size(), 1, ret.pixels[i]);
 		pca.project(input, output);
 	}
 
@@ -538,9 +557,8 @@ void multi_img::transpose()
 void multi_img::normalize_magnitudes()
 {
 	rebuildPixels(true);
-	std::vector<Pixel>::iterator it;
-	for (it = pixels.begin(); it != pixels.end(); ++it) {
-		cv::Mat_<Value> p(*it);
+	for (int i = 0; i < pixels.rows; ++i) {
+		cv::Mat_<Value> p = pixels.row(i);
 		double n = cv::norm(p, cv::NORM_L2);
 		if (n == 0.)
 			n = 1.;
@@ -208,6 +208,34 @@ public:
 	/** @note Pixel will always be a std::vector. You can count on this. **/
 	typedef std::vector<Value> Pixel;
 
+	/// read-only view on the spectral data of a pixel in the pixel cache
+	/** The view does not own its data. It is invalidated when the image is
+		destroyed or its cache is re-allocated (geometry change).
+		For convenience, it converts into a Pixel by copying the data. **/
+	class PixelView {
+	public:
+		typedef const Value* const_iterator;
+
+		PixelView() : ptr(0), len(0) {}
+		PixelView(const Value *data, size_t size) : ptr(data), len(size) {}
+
+		inline size_t size() const { return len; }
+		inline bool empty() const { return len == 0; }
+		inline const Value* data() const { return ptr; }
+		inline const_iterator begin() const { return ptr; }
+		inline const_iterator end() const { return ptr + len; }
+		inline const Value& operator[](size_t d) const
+		{ assert(d < len); return ptr[d]; }
+
+		/// copies the spectral data into a Pixel
+		inline Pixel toPixel() const { return Pixel(ptr, ptr + len); }
+		inline operator Pixel() const { return toPixel(); }
+
+	private:
+		const Value *ptr;
+		size_t len;
+	};
+
 //@}
 
 	enum NormMode {
@@ -281,25 +309,25 @@ public:
 	{ assert(band < size()); return bands[band]; }
 
 	/// returns spectral data of a single pixel
-	inline const Pixel& operator()(unsigned int row, unsigned int col) const
+	inline PixelView operator()(unsigned int row, unsigned int col) const
 	{	assert((int)row < height && (int)col < width);
 		if (anydirt && dirty(row, col))
 			rebuildPixel(row, col);
-		return pixels[row*width + col];
+		return PixelView(pixels[row*width + col], size());
 	}
 
 	/// returns spectral data of a single pixel
-	inline const Pixel& operator()(cv::Point pt) const
+	inline PixelView operator()(cv::Point pt) const
 	{ return operator ()(pt.y, pt.x); }
 
 	/// returns spectral data of a single pixel (only if *no* pixel is dirty!)
-	inline const Pixel& atIndex(unsigned int idx) const
+	inline PixelView atIndex(unsigned int idx) const
 	{	assert(!anydirt);
-		return pixels[idx];
+		return PixelView(pixels[idx], size());
 	}
 
 	/// returns spectral data of a segment (using mask)
-	std::vector<const Pixel*> getSegment(const cv::Mat1b &mask);
+	std::vector<PixelView> getSegment(const cv::Mat1b &mask);
 	/// returns copied spectral data of a segment (using mask)
 	std::vector<Pixel> getSegmentCopy(const cv::Mat1b &mask);
 
@@ -399,6 +427,11 @@ public:
 	inline static cv::Mat_<Value> toMat(const Pixel& p)
 	{ return cv::Mat_<Value>(p, true); }
 
+	/// copies PixelView into a OpenCV matrix (column vector, like above)
+	inline static cv::Mat_<Value> toMat(const PixelView& p)
+	{ return cv::Mat_<Value>((int)p.size(), 1,
+	                         const_cast<Value*>(p.data())).clone(); }
+
 	/// copies Matrix into a Pixel
 	inline static Pixel toPixel(const cv::Mat_<Value>& m)
 	{ return Pixel(m.begin(), m.end()); }
@@ -564,13 +597,24 @@ protected:
 	/// write back pixel cache into band data
 	void applyCache();
 
+	/// copy band data of a region into the pixel cache (blocked transpose)
+	/** @arg first, last band subrange [first, last) to copy */
+	void bandsToPixels(const cv::Rect &region,
+	                   size_t first, size_t last) const;
+
+	/// copy pixel cache of a region into band data (blocked transpose)
+	/** @arg first, last band subrange [first, last) to copy */
+	void pixelsToBands(const cv::Rect &region, size_t first, size_t last);
+
 	/// simple data structure initialization
 	void init(int height, int width, unsigned int size,
 			  Value minval = MULTI_IMG_MIN_DEFAULT,
 			  Value maxval = MULTI_IMG_MAX_DEFAULT);
 
 	std::vector<Band> bands;
-	mutable std::vector<Pixel> pixels;
+	/** pixel cache in band-interleaved-by-pixel order: one row per pixel
+		(row-major pixel index), one column per band, continuous memory */
+	mutable cv::Mat_<Value> pixels;
 	mutable cv::Mat1b dirty;
 	mutable bool anydirt;
 
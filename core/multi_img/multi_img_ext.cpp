@@ -47,9 +47,9 @@ multi_img multi_img::spec_rescale(unsigned int newsize) const
 	rebuildPixels();
 	for (int row = 0; row < height; ++row) {
 		for (int col = 0; col < width; ++col) {
-			/// delegate resizing to opencv, using mat headers over vectors
-			cv::Mat_<Value> src(pixels[row*width + col]),
-			                dst(ret.pixels[row*width + col]);
+			/// delegate resizing to opencv, using mat headers over the cache
+			cv::Mat_<Value> src((int)size(), 1, pixels[row*width + col]),
+			                dst((int)newsize, 1, ret.pixels[row*width + col]);
 			cv::resize(src, dst, cv::Size(1, newsize));
 		}
 	}
@@ -32,10 +32,11 @@ multi_img::export_ushort(bool useDataRange) const
 	std::vector<std::vector<unsigned short> >
 			ret(width*height, std::vector<unsigned short>(size()));
 
-	std::vector<Pixel>::const_iterator it = pixels.begin();
-	for (size_t i = 0; it != pixels.end(); ++it, ++i)
+	for (int i = 0; i < pixels.rows; ++i) {
+		const Value *p = pixels[i];
 		for (size_t d = 0; d < size(); ++d)
-			ret[i][d] = ((*it)[d] - range.min) * scale;
+			ret[i][d] = (p[d] - range.min) * scale;
+	}
 
 	return ret;
 }
@@ -138,7 +139,7 @@ void multi_img::read_image(const std::vector<std::string> &files,
 
 	/* invalidate pixel cache as pixel length has changed
 	   This step is _mandatory_ also to initialize cache containers */
-	pixels.clear();
+	pixels.release();
 	resetPixels();
 
 	/* add meta information if present. */
@@ -1,20 +1,176 @@
 #include "multi_img_offloaded.h"
+#include <hashes.h>
 #include <opencv2/highgui/highgui.hpp>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+
+#if defined(WITH_BOOST) && defined(WITH_BOOST_FILESYSTEM)
+	#define OFFLOADED_MMAP
+	#include <boost/filesystem.hpp>
+	#include <boost/interprocess/file_mapping.hpp>
+	#include <boost/interprocess/mapped_region.hpp>
+	namespace bfs = boost::filesystem;
+	namespace bip = boost::interprocess;
+#endif
+
+const size_t multi_img_offloaded::DefaultCacheBudget = 256 << 20;
+
+/* Layout of the band-sequential cache file:
+	CacheHeader
+	(padding)
+	band data at dataOffset, one plane of width x height Values per band
+	band table at tableOffset, one CacheBand per band
+*/
+struct CacheHeader {
+	char magic[8];
+	uint32_t version;
+	int32_t width, height;
+	uint32_t nbands;
+	float minval, maxval;
+	uint64_t signature;
+	uint64_t dataOffset;
+	uint64_t tableOffset;
+};
+
+struct CacheBand {
+	uint32_t file;
+	uint32_t channel;
+};
+
+static const char CACHE_MAGIC[8] = { 'G', 'E', 'R', 'B', 'B', 'S', 'Q', 0 };
+static const uint32_t CACHE_VERSION = 1;
+// band data is page-aligned
+static const uint64_t CACHE_DATA_OFFSET = 4096;
+
+#ifdef OFFLOADED_MMAP
+struct multi_img_offloaded::CacheFile {
+	/* we map copy-on-write so that users of a band can write to it like
+	   to any other band data, without touching the file */
+	CacheFile(const std::string &path)
+		: mapping(path.c_str(), bip::read_only),
+		  region(mapping, bip::copy_on_write) {}
+
+	char* address() const { return static_cast<char*>(region.get_address()); }
+
+	bip::file_mapping mapping;
+	bip::mapped_region region;
+};
+
+static unsigned long cacheSignature(const std::vector<std::string> &files,
+                                    float minval, float maxval)
+{
+	std::ostringstream s;
+	s << CACHE_VERSION << " " << minval << " " << maxval;
+	for (size_t fi = 0; fi < files.size(); ++fi) {
+		boost::system::error_code ec;
+		bfs::path p = bfs::absolute(files[fi]);
+		s << "\n" << p.string();
+		boost::uintmax_t fsize = bfs::file_size(p, ec);
+		if (!ec)
+			s << " " << fsize << " " << bfs::last_write_time(p, ec);
+	}
+	return Hashes::getHash(s.str().c_str(), Hashes::HASH_djb2);
+}
+#else
+struct multi_img_offloaded::CacheFile {};
+#endif
+
+/* Hack: when input was single RGB image, we assume RGB peak wavelengths
+		 (from Hamamatsu) to enable re-calculation of RGB image */
+// NOTE: for this to work as expected, incoming data still needs to
+//	have linear response, which is not true for typical RGB imaging
+static void initMeta(std::vector<multi_img::BandDesc> &meta,
+                     const std::vector<multi_img::BandDesc> &descs,
+                     size_t nfiles, size_t nbands, int channels)
+{
+	/* add meta information if present. */
+	if (!descs.empty()) {
+		assert(meta.size() + descs.size() == nbands);
+		meta.insert(meta.end(), descs.begin(), descs.end());
+	} else {
+		if (nfiles == 1 && channels == 3) {
+			meta.push_back(multi_img::BandDesc(460));
+			meta.push_back(multi_img::BandDesc(540));
+			meta.push_back(multi_img::BandDesc(620));
+		} else {
+			meta.resize(nbands);
+		}
+	}
+}
 
 multi_img_offloaded::multi_img_offloaded(const std::vector<std::string> &files,
-										 const std::vector<BandDesc> &descs)
+                                         const std::vector<BandDesc> &descs,
+                                         size_t cacheBudget,
+                                         const std::string &cacheDir)
+	: cache(0), lruBytes(0), lruBudget(cacheBudget)
 {
-	int channels = 0;
 	width = 0;
 	height = 0;
 
-	for (size_t fi = 0; fi < files.size(); ++fi) {
-		cv::Mat src = cv::imread(files[fi], -1); // flag -1: preserve format
+	/* default to our favorite range */
+	minval = MULTI_IMG_MIN_DEFAULT;
+	maxval = MULTI_IMG_MAX_DEFAULT;
 
-		if (src.empty()) {
-			std::cerr << "ERROR: Failed to load " << files[fi] << std::endl;
-			continue;
+	std::string path;
+	unsigned long signature = 0;
+#ifdef OFFLOADED_MMAP
+	signature = cacheSignature(files, minval, maxval);
+	{
+		boost::system::error_code ec;
+		bfs::path dir = (cacheDir.empty() ? bfs::temp_directory_path(ec)
+		                                  : bfs::path(cacheDir));
+		if (!ec) {
+			std::ostringstream name;
+			name << "gerbil-" << std::hex << std::setw(16) << std::setfill('0')
+			     << signature << ".bsq";
+			path = (dir / name.str()).string();
 		}
+	}
+#endif
+
+	if (!path.empty() && openCache(path, signature, files)) {
+		std::cout << "Using band cache " << path << std::endl;
+		int channels = (files.size() == 1 ? (int)bands.size() : 0);
+		initMeta(meta, descs, files.size(), bands.size(), channels);
+	} else {
+		readFiles(files, descs, path, signature);
+	}
+
+	if (bands.size())
+		std::cout << "Total of " << bands.size() << " bands. "
+			 << "Spatial size: " << width << "x" << height
+			 << "   (" << bands.size()*width*height*sizeof(Value)/1048576.
+			 << " MB)" << std::endl;
+}
+
+multi_img_offloaded::~multi_img_offloaded()
+{
+	delete cache;
+}
+
+void multi_img_offloaded::readFiles(const std::vector<std::string> &files,
+                                    const std::vector<BandDesc> &descs,
+                                    const std::string &path,
+                                    unsigned long signature)
+{
+	int channels = 0;
+	std::vector<CacheBand> table;
+
+	// cache file is written to temporary name, then renamed when complete
+	std::string tmppath = path + ".tmp";
+	std::ofstream out;
+	if (!path.empty()) {
+		out.open(tmppath.c_str(), std::ios::out | std::ios::binary);
+		out.seekp(CACHE_DATA_OFFSET);
+	}
+
+	for (size_t fi = 0; fi < files.size(); ++fi) {
+		cv::Mat src;
+		int depth = 0;
+		if (!decodeFile(files[fi], src, &depth))
+			continue;
 
 		// test spatial size
 		if (width > 0 && (src.cols != width || src.rows != height)) {
@@ -27,53 +183,136 @@ multi_img_offloaded::multi_img_offloaded(const std::vector<std::string> &files,
 		width = src.cols;
 		height = src.rows;
 
-		/* default to our favorite range */
-		minval = MULTI_IMG_MIN_DEFAULT;
-		maxval = MULTI_IMG_MAX_DEFAULT;
-
-		// split & add everything in at the end
+		// add everything, write band planes in order
 		channels = src.channels();
-		if (channels > 1) {
-			std::vector<cv::Mat> splitted(channels);
-			cv::split(src, splitted);
-			for (size_t c = 0; c < splitted.size(); ++c)
-				bands.push_back(std::make_pair(files[fi], c));
-		} else {
-			bands.push_back(std::make_pair(files[fi], 0));
+		for (int c = 0; c < channels; ++c) {
+			bands.push_back(std::make_pair(files[fi], c));
+			CacheBand entry = { (uint32_t)fi, (uint32_t)c };
+			table.push_back(entry);
+			if (out.good()) {
+				Band plane;
+				if (channels > 1)
+					cv::extractChannel(src, plane, c);
+				else
+					plane = src;
+				out.write(reinterpret_cast<const char*>(plane.ptr()),
+				          plane.total() * sizeof(Value));
+			}
 		}
 
 		std::cout << "Added " << files[fi] << ":\t" << channels
 			 << (channels == 1 ? " channel, " : " channels, ")
-			 << (src.depth() == CV_16U ? 16 : 8) << " bits";
+			 << (depth == CV_16U ? 16 : 8) << " bits";
 		if (descs.empty() || descs[fi].empty)
 			std::cout << std::endl;
 		else
 			std::cout << ", " << descs[fi].center << " nm" << std::endl;
 	}
 
-	/* add meta information if present. */
-	if (!descs.empty()) {
-		assert(meta.size() + descs.size() == bands.size());
-		meta.insert(meta.end(), descs.begin(), descs.end());
-	} else {
-		/* Hack: when input was single RGB image, we assume RGB peak wavelengths
-				 (from Hamamatsu) to enable re-calculation of RGB image */
-		// NOTE: for this to work as expected, incoming data still needs to
-		//	have linear response, which is not true for typical RGB imaging
-		if (files.size() == 1 && channels == 3) {
-			meta.push_back(BandDesc(460));
-			meta.push_back(BandDesc(540));
-			meta.push_back(BandDesc(620));
-		} else {
-			meta.resize(bands.size());
+	initMeta(meta, descs, files.size(), bands.size(), channels);
+
+#ifdef OFFLOADED_MMAP
+	if (!out.is_open()) {
+		if (!path.empty())
+			std::cerr << "WARNING: Could not create band cache " << path
+			          << ", bands will be decoded on demand." << std::endl;
+		return;
+	}
+
+	// finish cache file: band table, then header
+	CacheHeader header;
+	std::copy(CACHE_MAGIC, CACHE_MAGIC + 8, header.magic);
+	header.version = CACHE_VERSION;
+	header.width = width;
+	header.height = height;
+	header.nbands = (uint32_t)bands.size();
+	header.minval = minval;
+	header.maxval = maxval;
+	header.signature = signature;
+	header.dataOffset = CACHE_DATA_OFFSET;
+	header.tableOffset = CACHE_DATA_OFFSET
+	        + (uint64_t)bands.size() * width * height * sizeof(Value);
+	if (!table.empty())
+		out.write(reinterpret_cast<const char*>(&table[0]),
+		          table.size() * sizeof(CacheBand));
+	out.seekp(0);
+	out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+	bool written = out.good();
+	out.close();
+
+	boost::system::error_code ec;
+	if (written && !bands.empty()) {
+		bfs::rename(tmppath, path, ec);
+		written = !ec;
+	}
+	if (!written) {
+		std::cerr << "WARNING: Could not write band cache " << path
+		          << ", bands will be decoded on demand." << std::endl;
+		bfs::remove(tmppath, ec);
+		return;
+	}
+
+	// re-open cache, this time mapped (bands stay untouched on failure)
+	openCache(path, signature, files);
+#endif
+}
+
+bool multi_img_offloaded::openCache(const std::string &path,
+                                    unsigned long signature,
+                                    const std::vector<std::string> &files)
+{
+#ifdef OFFLOADED_MMAP
+	boost::system::error_code ec;
+	if (!bfs::exists(path, ec))
+		return false;
+
+	CacheFile *file = 0;
+	try {
+		file = new CacheFile(path);
+	} catch (const bip::interprocess_exception &e) {
+		std::cerr << "WARNING: Could not map band cache " << path << ": "
+		          << e.what() << std::endl;
+		return false;
+	}
+
+	const uint64_t fsize = file->region.get_size();
+	const CacheHeader &h = *reinterpret_cast<CacheHeader*>(file->address());
+	bool valid = fsize >= sizeof(CacheHeader)
+	        && std::equal(CACHE_MAGIC, CACHE_MAGIC + 8, h.magic)
+	        && h.version == CACHE_VERSION
+	        && h.signature == (uint64_t)signature
+	        && h.width > 0 && h.height > 0 && h.nbands > 0
+	        && h.tableOffset == h.dataOffset + (uint64_t)h.nbands
+	                            * h.width * h.height * sizeof(Value)
+	        && fsize >= h.tableOffset + h.nbands * sizeof(CacheBand);
+	if (!valid) {
+		delete file;
+		return false;
+	}
+
+	const CacheBand *table =
+	        reinterpret_cast<CacheBand*>(file->address() + h.tableOffset);
+	std::vector<std::pair<std::string, int> > entries;
+	for (uint32_t b = 0; b < h.nbands; ++b) {
+		if (table[b].file >= files.size()) {
+			delete file;
+			return false;
 		}
+		entries.push_back(std::make_pair(files[table[b].file],
+		                                 (int)table[b].channel));
 	}
 
-	if (bands.size())
-		std::cout << "Total of " << bands.size() << " bands. "
-			 << "Spatial size: " << width << "x" << height
-			 << "   (" << bands.size()*width*height*sizeof(Value)/1048576.
-			 << " MB)" << std::endl;
+	bands.swap(entries);
+	width = h.width;
+	height = h.height;
+	minval = h.minval;
+	maxval = h.maxval;
+	delete cache;
+	cache = file;
+	return true;
+#else
+	return false;
+#endif
 }
 
 size_t multi_img_offloaded::size() const
@@ -92,13 +331,14 @@ void multi_img_offloaded::scopeBand(const Band &source, const cv::Rect &roi, Ban
 	target = scoped.clone();
 }
 
-void multi_img_offloaded::getBand(size_t band, Band &data) const
+bool multi_img_offloaded::decodeFile(const std::string &file, cv::Mat &data,
+                                     int *depth) const
 {
-	cv::Mat src = cv::imread(bands[band].first, -1); // flag -1: preserve format
+	cv::Mat src = cv::imread(file, -1); // flag -1: preserve format
 
 	if (src.empty()) {
-		std::cerr << "ERROR: Failed to load " << bands[band].first << std::endl;
-		return;
+		std::cerr << "ERROR: Failed to load " << file << std::endl;
+		return false;
 	}
 
 	// find original data range, we assume minimum is 0
@@ -111,33 +351,99 @@ void multi_img_offloaded::getBand(size_t band, Band &data) const
 	case CV_32F:
 	case CV_64F: { srcmaxval = 1.; break; }
 	default: // we don't handle other formats!
-		std::cerr << "Input data type of " << bands[band].first
+		std::cerr << "Input data type of " << file
 				  << " is not compatible!" << std::endl;
-		return;
+		return false;
 	}
+	if (depth)
+		*depth = src.depth();
 
 	// convert to right datatype, scaling
-	cv::Mat tmp;
-	src.convertTo(tmp, ValueType);
+	src.convertTo(data, ValueType);
 
 	// rescale data accordingly
 	if (srcminval == 0. && minval == 0.) {
 		if (maxval != srcmaxval)
-			tmp *= maxval/srcmaxval;
+			data *= maxval/srcmaxval;
 	} else {
 		Value scale = (maxval - minval)/(srcmaxval - srcminval);
-		tmp = (tmp - srcminval) * scale;
+		data = (data - srcminval) * scale;
 		if (minval != 0.)
-			tmp += minval;
+			data += minval;
 	}
+	return true;
+}
+
+void multi_img_offloaded::getBand(size_t band, Band &data) const
+{
+#ifdef OFFLOADED_MMAP
+	if (cache) {
+		const CacheHeader &h =
+		        *reinterpret_cast<const CacheHeader*>(cache->address());
+		char *plane = cache->address() + h.dataOffset
+		        + (uint64_t)band * width * height * sizeof(Value);
+		data = Band(height, width, reinterpret_cast<Value*>(plane));
+		return;
+	}
+#endif
+
+	{
+		tbb::mutex::scoped_lock lock(lruMutex);
+		std::map<size_t, LruList::iterator>::iterator it = lruIndex.find(band);
+		if (it != lruIndex.end()) {
+			lru.splice(lru.begin(), lru, it->second);
+			data = it->second->second;
+			return;
+		}
+	}
+
+	cv::Mat tmp;
+	if (!decodeFile(bands[band].first, tmp))
+		return;
 
-	// split & add everything in at the end
+	// keep all channels of the file, they are likely requested next
 	size_t cc = tmp.channels();
 	if (cc > 1) {
 		std::vector<Band> channels(cc);
 		cv::split(tmp, channels);
+		for (size_t b = 0; b < bands.size(); ++b) {
+			if (b != band && bands[b].first == bands[band].first)
+				lruInsert(b, channels[bands[b].second]);
+		}
 		data = channels[bands[band].second];
 	} else {
 		data = tmp;
 	}
+	lruInsert(band, data);
+}
+
+void multi_img_offloaded::lruInsert(size_t band, const Band &data) const
+{
+	tbb::mutex::scoped_lock lock(lruMutex);
+	std::map<size_t, LruList::iterator>::iterator it = lruIndex.find(band);
+	if (it != lruIndex.end()) {
+		lruBytes -= it->second->second.total() * sizeof(Value);
+		lru.erase(it->second);
+	}
+	lru.push_front(std::make_pair(band, data));
+	lruIndex[band] = lru.begin();
+	lruBytes += data.total() * sizeof(Value);
+
+	// evict, but always keep the band we just inserted
+	while (lruBytes > lruBudget && lru.size() > 1) {
+		lruBytes -= lru.back().second.total() * sizeof(Value);
+		lruIndex.erase(lru.back().first);
+		lru.pop_back();
+	}
+}
+
+void multi_img_offloaded::setCacheBudget(size_t bytes)
+{
+	tbb::mutex::scoped_lock lock(lruMutex);
+	lruBudget = bytes;
+	while (lruBytes > lruBudget && !lru.empty()) {
+		lruBytes -= lru.back().second.total() * sizeof(Value);
+		lruIndex.erase(lru.back().first);
+		lru.pop_back();
+	}
 }
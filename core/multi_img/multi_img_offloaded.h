@@ -2,14 +2,42 @@
 #define MULTI_IMG_OFFLOADED_H
 
 #include <multi_img.h>
+#include <tbb/mutex.h>
+#include <list>
+#include <map>
 
+/** Image with limited functionality and bands offloaded to persistent storage.
+
+	On first open, all source files are decoded once and written into an
+	uncompressed band-sequential cache file (by default in the system's
+	temporary directory). This file is memory-mapped and getBand() returns
+	Band headers directly over the mapping (zero-copy). On following opens of
+	the same, unchanged, file list the cache is reused and no decoding happens.
+
+	If the cache file is not available, bands are decoded from the source files
+	on demand. Decoded bands are kept in an LRU cache with a memory budget; all
+	channels of a multichannel file enter the cache on a single decode.
+
+	@note Band data returned by getBand() is only valid as long as the image
+		  exists. Modifications to it are not written back to the cache file.
+ */
 class multi_img_offloaded : public multi_img_base {
 public:
+	/// default memory budget of the decoded band cache (bytes)
+	static const size_t DefaultCacheBudget;
+
 	/// creates the multi_img with limited functionality and with bands offloaded to persistent storage
-	multi_img_offloaded(const std::vector<std::string> &files, const std::vector<BandDesc> &descs);
+	/**	@arg cacheBudget memory budget of the decoded band cache (bytes)
+		@arg cacheDir directory for the band-sequential cache file, if empty,
+			 the system's temporary directory is used
+	 */
+	multi_img_offloaded(const std::vector<std::string> &files,
+	                    const std::vector<BandDesc> &descs,
+	                    size_t cacheBudget = DefaultCacheBudget,
+	                    const std::string &cacheDir = std::string());
 
-	/// virtual destructor, does nothing
-	virtual ~multi_img_offloaded() {}
+	/// virtual destructor, releases file mapping
+	virtual ~multi_img_offloaded();
 
 	/// returns number of bands
 	virtual size_t size() const;
@@ -23,10 +51,51 @@ public:
 	/// returns the roi part of the given band
 	virtual void scopeBand(const Band &source, const cv::Rect &roi, Band &target) const;
 
+	/// change memory budget of the decoded band cache (bytes)
+	void setCacheBudget(size_t bytes);
+
+	/// returns true if bands are served from the memory-mapped cache file
+	bool isMapped() const { return cache != 0; }
+
 protected:
+	/// decode a file and convert it to Value type, scaled to minval/maxval
+	/** @return false if file could not be read or has unsupported format */
+	bool decodeFile(const std::string &file, cv::Mat &data,
+	                int *depth = 0) const;
+
+	/// map existing cache file, returns true if it matches our file list
+	bool openCache(const std::string &path, unsigned long signature,
+	               const std::vector<std::string> &files);
+
+	/// decode all files, fill bands and write the cache file
+	void readFiles(const std::vector<std::string> &files,
+	               const std::vector<BandDesc> &descs,
+	               const std::string &path, unsigned long signature);
+
+	/// put band into decoded band cache, evicting old bands as needed
+	void lruInsert(size_t band, const Band &data) const;
+
+	/// source file and channel of each band
 	std::vector<std::pair<std::string, int> > bands;
 
+	/// memory-mapped cache file (opaque, 0 if not available)
+	struct CacheFile;
+	CacheFile *cache;
+
+	/// LRU of decoded bands, most recently used at front
+	typedef std::list<std::pair<size_t, Band> > LruList;
+	mutable LruList lru;
+	mutable std::map<size_t, LruList::iterator> lruIndex;
+	mutable size_t lruBytes;
+	size_t lruBudget;
+	mutable tbb::mutex lruMutex;
+
 	MULTI_IMG_FRIENDS
+
+private:
+	// not copyable (owns file mapping)
+	multi_img_offloaded(const multi_img_offloaded&);
+	multi_img_offloaded& operator=(const multi_img_offloaded&);
 };
 
 #endif // MULTI_IMG_OFFLOADED_H
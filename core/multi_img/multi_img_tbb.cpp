@@ -9,49 +9,37 @@
 #include <cstddef>
 #include <algorithm>
 
+static inline cv::Rect toRect(const tbb::blocked_range2d<int> &r)
+{
+	return cv::Rect(r.cols().begin(), r.rows().begin(),
+	                r.cols().size(), r.rows().size());
+}
+
 void RebuildPixels::operator()(const tbb::blocked_range<size_t> &r) const
 {
 	for (size_t d = r.begin(); d != r.end(); ++d) {
-		multi_img::Band &src = multi.bands[d];
-		if (src.empty()) {
+		if (multi.bands[d].empty()) {
 			return;
 		}
-		multi_img::Band::const_iterator it; size_t i;
-		for (it = src.begin(), i = 0; it != src.end(); ++it, ++i)
-			multi.pixels[i][d] = *it;
 	}
+	multi.bandsToPixels(cv::Rect(0, 0, multi.width, multi.height),
+	                    r.begin(), r.end());
 }
 
 void RebuildPixels::operator()(const tbb::blocked_range2d<int> &r) const
 {
-	for (int row = r.rows().begin(); row != r.rows().end(); ++row) {
-		int loc = row * multi.width;
-		for (int col = r.cols().begin(); col != r.cols().end(); ++col) {
-			for (size_t d = 0; d < multi.size(); ++d)
-				multi.pixels[loc + col][d] = multi.bands[d](row, col);
-		}
-	}
+	multi.bandsToPixels(toRect(r), 0, multi.size());
 }
 
 void ApplyCache::operator()(const tbb::blocked_range<size_t> &r) const
 {
-	for (size_t d = r.begin(); d != r.end(); ++d) {
-		multi_img::Band &dst = multi.bands[d];
-		multi_img::Band::iterator it; size_t i;
-		for (it = dst.begin(), i = 0; it != dst.end(); ++it, ++i)
-			*it = multi.pixels[i][d];
-	}
+	multi.pixelsToBands(cv::Rect(0, 0, multi.width, multi.height),
+	                    r.begin(), r.end());
 }
 
 void ApplyCache::operator()(const tbb::blocked_range2d<int> &r) const
 {
-	for (int row = r.rows().begin(); row != r.rows().end(); ++row) {
-		int loc = row * multi.width;
-		for (int col = r.cols().begin(); col != r.cols().end(); ++col) {
-			for (size_t d = 0; d < multi.size(); ++d)
-				multi.bands[d](row, col) = multi.pixels[loc + col][d];
-		}
-	}
+	multi.pixelsToBands(toRect(r), 0, multi.size());
 }
 
 void DetermineRange::operator()(const tbb::blocked_range<size_t> &r)
@@ -156,10 +144,10 @@ void NormL2::operator()(const tbb::blocked_range2d<int> &r) const
 {
 	for (int row = r.rows().begin(); row != r.rows().end(); ++row) {
 		for (int col = r.cols().begin(); col != r.cols().end(); ++col) {
-			cv::Mat_<multi_img::Value> src(
-						source.pixels[row * source.width + col], false);
-			cv::Mat_<multi_img::Value> dst(
-						target.pixels[row * source.width + col], false);
+			cv::Mat_<multi_img::Value> src((int)source.size(), 1,
+						source.pixels[row * source.width + col]);
+			cv::Mat_<multi_img::Value> dst((int)target.size(), 1,
+						target.pixels[row * source.width + col]);
 			double n = cv::norm(src, cv::NORM_L2);
 			if (n == 0.)
 				n = 1.;
@@ -200,7 +188,8 @@ void PcaProjection::operator ()(const tbb::blocked_range<size_t> &r) const
 {
 	for (size_t i = r.begin(); i != r.end(); ++i) {
 		cv::Mat_<multi_img::Value> input = source.col(i);
-		cv::Mat_<multi_img::Value> output(target.pixels[i], false);
+		cv::Mat_<multi_img::Value> output((int)target.size(), 1,
+		                                  target.pixels[i]);
 		pca.project(input, output);
 	}
 }
@@ -220,10 +209,10 @@ void Resize::operator()(const tbb::blocked_range2d<int> &r) const
 {
 	for (int row = r.rows().begin(); row != r.rows().end(); ++row) {
 		for (int col = r.cols().begin(); col != r.cols().end(); ++col) {
-			cv::Mat_<multi_img::Value> src(
-			            source.pixels[row * source.width + col], false);
-			cv::Mat_<multi_img::Value> dst(
-			            target.pixels[row * source.width + col], false);
+			cv::Mat_<multi_img::Value> src((int)source.size(), 1,
+			            source.pixels[row * source.width + col]);
+			cv::Mat_<multi_img::Value> dst((int)target.size(), 1,
+			            target.pixels[row * source.width + col]);
 			cv::resize(src, dst, cv::Size(1, newsize));
 		}
 	}
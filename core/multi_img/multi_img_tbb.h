@@ -5,23 +5,27 @@
 #include <tbb/blocked_range.h>
 #include <tbb/blocked_range2d.h>
 
-// TODO doc
+/** Copies band data into the interleaved pixel cache (blocked transpose).
+	Prefer the 2d variant: each task then writes whole pixel vectors. */
 class RebuildPixels {
 public:
 	RebuildPixels(multi_img &multi) : multi(multi) {}
+	// range over bands, all pixels
 	void operator()(const tbb::blocked_range<size_t> &r) const;
-	// second way to do it that can also be run on a specific region
+	// range over rows and columns, all bands (can be run on a region)
 	void operator()(const tbb::blocked_range2d<int> &r) const;
 private:
 	multi_img &multi;
 };
 
-// TODO doc
+/** Copies the interleaved pixel cache back into band data (blocked
+	transpose). Prefer the 2d variant, see RebuildPixels. */
 class ApplyCache {
 public:
 	ApplyCache(multi_img &multi) : multi(multi) {}
+	// range over bands, all pixels
 	void operator()(const tbb::blocked_range<size_t> &r) const;
-	// second way to do it that can also be run on a specific region
+	// range over rows and columns, all bands (can be run on a region)
 	void operator()(const tbb::blocked_range2d<int> &r) const;
 private:
 	multi_img &multi;
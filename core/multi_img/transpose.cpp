@@ -0,0 +1,221 @@
+/*
+	Copyright(c) 2012 Johannes Jordan <johannes.jordan@cs.fau.de>.
+
+	This file may be licensed under the terms of of the GNU General Public
+	License, version 3, as published by the Free Software Foundation. You can
+	find it here: http://www.gnu.org/licenses/gpl.html
+*/
+
+#include "transpose.h"
+
+#include <algorithm>
+#include <xmmintrin.h>
+#include <emmintrin.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#include <immintrin.h>
+	#define TRANSPOSE_HAVE_AVX
+	#define TRANSPOSE_AVX_TARGET __attribute__((target("avx")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	#include <intrin.h>
+	#include <immintrin.h>
+	#define TRANSPOSE_HAVE_AVX
+	#define TRANSPOSE_AVX_TARGET
+#endif
+
+namespace transpose {
+
+/* Pixels processed per outer block. The interleaved side of a block
+   (COLBLOCK * stride floats) should stay in L1/L2 while all bands pass. */
+static const size_t COLBLOCK = 64;
+
+/* Kernel signature: transpose a tile of T x T floats, reading T rows from
+   in[] and writing T rows to out[]. */
+typedef void (*TileKernel)(const float *const *in, float *const *out);
+
+static void tileScalar(const float *const *in, float *const *out, size_t t)
+{
+	for (size_t i = 0; i < t; ++i)
+		for (size_t j = 0; j < t; ++j)
+			out[j][i] = in[i][j];
+}
+
+static void tileSSE2(const float *const *in, float *const *out)
+{
+	__m128 r0 = _mm_loadu_ps(in[0]), r1 = _mm_loadu_ps(in[1]),
+	       r2 = _mm_loadu_ps(in[2]), r3 = _mm_loadu_ps(in[3]);
+	_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+	_mm_storeu_ps(out[0], r0); _mm_storeu_ps(out[1], r1);
+	_mm_storeu_ps(out[2], r2); _mm_storeu_ps(out[3], r3);
+}
+
+#ifdef TRANSPOSE_HAVE_AVX
+TRANSPOSE_AVX_TARGET
+static void tileAVX(const float *const *in, float *const *out)
+{
+	__m256 r0 = _mm256_loadu_ps(in[0]), r1 = _mm256_loadu_ps(in[1]),
+	       r2 = _mm256_loadu_ps(in[2]), r3 = _mm256_loadu_ps(in[3]),
+	       r4 = _mm256_loadu_ps(in[4]), r5 = _mm256_loadu_ps(in[5]),
+	       r6 = _mm256_loadu_ps(in[6]), r7 = _mm256_loadu_ps(in[7]);
+
+	// interleave pairs of rows
+	__m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1),
+	       t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3),
+	       t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5),
+	       t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+	// gather 4x4 blocks within each 128 bit lane
+	r0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	r1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	r2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	r3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+	r4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+	r5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+	r6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+	r7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+	// swap lanes
+	_mm256_storeu_ps(out[0], _mm256_permute2f128_ps(r0, r4, 0x20));
+	_mm256_storeu_ps(out[1], _mm256_permute2f128_ps(r1, r5, 0x20));
+	_mm256_storeu_ps(out[2], _mm256_permute2f128_ps(r2, r6, 0x20));
+	_mm256_storeu_ps(out[3], _mm256_permute2f128_ps(r3, r7, 0x20));
+	_mm256_storeu_ps(out[4], _mm256_permute2f128_ps(r0, r4, 0x31));
+	_mm256_storeu_ps(out[5], _mm256_permute2f128_ps(r1, r5, 0x31));
+	_mm256_storeu_ps(out[6], _mm256_permute2f128_ps(r2, r6, 0x31));
+	_mm256_storeu_ps(out[7], _mm256_permute2f128_ps(r3, r7, 0x31));
+}
+#endif
+
+static bool cpuHasAVX()
+{
+#if defined(TRANSPOSE_HAVE_AVX) && defined(__GNUC__)
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx");
+#elif defined(TRANSPOSE_HAVE_AVX) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	// the OS also needs to save the YMM registers on context switch
+	return osxsave && avx && ((_xgetbv(0) & 6) == 6);
+#else
+	return false;
+#endif
+}
+
+Isa detectIsa()
+{
+	// determined once, thread-safe initialization in C++11
+	static const Isa isa = (cpuHasAVX() ? ISA_AVX : ISA_SSE2);
+	return isa;
+}
+
+const char* isaName(Isa isa)
+{
+	switch (isa) {
+	case ISA_AUTO:   return isaName(detectIsa());
+	case ISA_SCALAR: return "scalar";
+	case ISA_SSE2:   return "SSE2";
+	case ISA_AVX:    return "AVX";
+	}
+	return "unknown";
+}
+
+static void selectKernel(Isa isa, TileKernel &kernel, size_t &tile)
+{
+	if (isa == ISA_AUTO)
+		isa = detectIsa();
+	kernel = 0;
+	tile = 4;
+#ifdef TRANSPOSE_HAVE_AVX
+	if (isa == ISA_AVX) {
+		kernel = tileAVX;
+		tile = 8;
+		return;
+	}
+#endif
+	if (isa == ISA_SSE2 || isa == ISA_AVX)
+		kernel = tileSSE2;
+}
+
+void bandsToPixels(const float *const *src, size_t nbands, size_t cols,
+                   float *dst, size_t stride, Isa isa)
+{
+	TileKernel kernel;
+	size_t t;
+	selectKernel(isa, kernel, t);
+
+	const float *in[8];
+	float *out[8];
+	for (size_t c0 = 0; c0 < cols; c0 += COLBLOCK) {
+		const size_t c1 = std::min(c0 + COLBLOCK, cols);
+		size_t d = 0;
+		for (; d + t <= nbands; d += t) {
+			size_t c = c0;
+			for (; c + t <= c1; c += t) {
+				for (size_t k = 0; k < t; ++k) {
+					in[k] = src[d + k] + c;
+					out[k] = dst + (c + k)*stride + d;
+				}
+				if (kernel)
+					kernel(in, out);
+				else
+					tileScalar(in, out, t);
+			}
+			// remaining pixels of the block
+			for (size_t k = 0; k < t; ++k) {
+				const float *s = src[d + k];
+				for (size_t cc = c; cc < c1; ++cc)
+					dst[cc*stride + d + k] = s[cc];
+			}
+		}
+		// remaining bands
+		for (; d < nbands; ++d) {
+			const float *s = src[d];
+			for (size_t c = c0; c < c1; ++c)
+				dst[c*stride + d] = s[c];
+		}
+	}
+}
+
+void pixelsToBands(const float *src, size_t stride, size_t nbands,
+                   size_t cols, float *const *dst, Isa isa)
+{
+	TileKernel kernel;
+	size_t t;
+	selectKernel(isa, kernel, t);
+
+	const float *in[8];
+	float *out[8];
+	for (size_t c0 = 0; c0 < cols; c0 += COLBLOCK) {
+		const size_t c1 = std::min(c0 + COLBLOCK, cols);
+		size_t d = 0;
+		for (; d + t <= nbands; d += t) {
+			size_t c = c0;
+			for (; c + t <= c1; c += t) {
+				for (size_t k = 0; k < t; ++k) {
+					in[k] = src + (c + k)*stride + d;
+					out[k] = dst[d + k] + c;
+				}
+				if (kernel)
+					kernel(in, out);
+				else
+					tileScalar(in, out, t);
+			}
+			// remaining pixels of the block
+			for (size_t k = 0; k < t; ++k) {
+				float *o = dst[d + k];
+				for (size_t cc = c; cc < c1; ++cc)
+					o[cc] = src[cc*stride + d + k];
+			}
+		}
+		// remaining bands
+		for (; d < nbands; ++d) {
+			float *o = dst[d];
+			for (size_t c = c0; c < c1; ++c)
+				o[c] = src[c*stride + d];
+		}
+	}
+}
+
+}
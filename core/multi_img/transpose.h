@@ -0,0 +1,57 @@
+/*
+	Copyright(c) 2012 Johannes Jordan <johannes.jordan@cs.fau.de>.
+
+	This file may be licensed under the terms of of the GNU General Public
+	License, version 3, as published by the Free Software Foundation. You can
+	find it here: http://www.gnu.org/licenses/gpl.html
+*/
+
+#ifndef MULTI_IMG_TRANSPOSE_H
+#define MULTI_IMG_TRANSPOSE_H
+
+#include <cstddef>
+
+/** Conversion kernels between band planes and interleaved pixel data.
+
+	Both directions work on one image row at a time. The band side is given
+	as one pointer per band (bands are distinct matrices and may be ROI
+	headers), the pixel side as one pointer with a stride of @a stride floats
+	between consecutive pixels. The work is done in 8x8 (AVX) or 4x4 (SSE2)
+	register tiles, remainders are handled by scalar code.
+
+	The instruction set is chosen at runtime, based on the executing CPU.
+ */
+namespace transpose {
+
+enum Isa {
+	ISA_AUTO = -1,
+	ISA_SCALAR = 0,
+	ISA_SSE2,
+	ISA_AVX
+};
+
+/// best instruction set supported by the CPU we are running on
+Isa detectIsa();
+
+/// human-readable name of instruction set
+const char* isaName(Isa isa);
+
+/// copy @a cols pixels of @a nbands bands into interleaved storage
+/** @arg src one pointer per band, pointing to the first column
+	@arg dst pointer to the first band of the first pixel
+	@arg stride distance between consecutive pixels in dst (>= nbands)
+ */
+void bandsToPixels(const float *const *src, size_t nbands, size_t cols,
+                   float *dst, size_t stride, Isa isa = ISA_AUTO);
+
+/// copy @a cols pixels of @a nbands bands from interleaved storage
+/** @arg src pointer to the first band of the first pixel
+	@arg stride distance between consecutive pixels in src (>= nbands)
+	@arg dst one pointer per band, pointing to the first column
+ */
+void pixelsToBands(const float *src, size_t stride, size_t nbands,
+                   size_t cols, float *const *dst, Isa isa = ISA_AUTO);
+
+}
+
+#endif // MULTI_IMG_TRANSPOSE_H
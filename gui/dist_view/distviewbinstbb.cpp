@@ -154,7 +154,7 @@ void Accumulate::operator()(const tbb::blocked_range2d<int> &r) const
 
 			int label = (ignoreLabels ? 0 : lr[x]);
 			label = (label >= (int)sets.size()) ? 0 : label;
-			const multi_img::Pixel& pixel = multi(y, x);
+			multi_img::PixelView pixel = multi(y, x);
 			BinSet &s = sets[label];
 
 			BinSet::HashKey hashkey(multi.size());
@@ -40,7 +40,7 @@ struct Bin {
 	/* we store the mean/avg. of all pixel vectors represented by this bin
 	 * the mean is not normalized during filling the bin, only afterwards
 	 */
-	inline void add(const multi_img::Pixel& p) {
+	inline void add(const multi_img::PixelView& p) {
 		/* weight holds the number of pixels this bin represents
 		 */
 		weight += 1.f;
@@ -51,7 +51,7 @@ struct Bin {
 	}
 
 	/* in incremental update of our BinSet, we can also remove pixels from a bin */
-	inline void sub(const multi_img::Pixel& p) {
+	inline void sub(const multi_img::PixelView& p) {
 		weight -= 1.f;
 		assert(!means.empty());
 		std::transform(means.begin(), means.end(), p.begin(), means.begin(),
@@ -335,7 +335,7 @@ QPolygonF DistViewModel::getPixelOverlay(int y, int x)
 		return QPolygonF();
 	}
 
-	const multi_img::Pixel &pixel = (**image)(y, x);
+	multi_img::PixelView pixel = (**image)(y, x);
 	QPolygonF points((*image)->size());
 
 	for (unsigned int d = 0; d < (*image)->size(); ++d) {
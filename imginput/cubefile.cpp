@@ -0,0 +1,563 @@
+#ifdef WITH_BOOST
+
+#include "imginput.h"
+#include "cubefile.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/atomic.h>
+
+#ifdef WITH_LZ4
+#include <lz4.h>
+#endif
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace bip = boost::interprocess;
+
+namespace imginput {
+
+const char *CubeFile::Extension = ".gcube";
+
+static const char Magic[8] = { 'G', 'E', 'R', 'B', 'C', 'U', 'B', 'E' };
+static const uint32_t Version = 1;
+static const uint32_t ByteOrderMark = 0x01020304;
+
+enum Codec {
+	CODEC_RAW = 0,
+	CODEC_LZ4 = 1
+};
+
+/* File layout:
+   - magic, version, byte order mark, sizeof(Value)
+   - width, height, bands, tile size, band block size, histogram bins
+   - minval, maxval
+   - per band: center, rangeStart, rangeEnd, empty, min, max, histogram
+   - per chunk: offset, compressed size, codec
+   - chunk data
+   Chunks are ordered by band block, then tile row, then tile column. */
+
+/// chunk layout of an image
+struct CubeGeometry {
+	CubeGeometry(int width, int height, int nbands, int tile, int bandblock)
+		: width(width), height(height), nbands(nbands),
+		  tile(tile), bandblock(bandblock),
+		  tilesX((width + tile - 1) / tile),
+		  tilesY((height + tile - 1) / tile),
+		  blocks((nbands + bandblock - 1) / bandblock) {}
+
+	size_t chunks() const { return (size_t)blocks * tilesY * tilesX; }
+
+	size_t index(int block, int ty, int tx) const
+	{ return ((size_t)block * tilesY + ty) * tilesX + tx; }
+
+	cv::Rect tileRect(int tx, int ty) const
+	{
+		return cv::Rect(tx * tile, ty * tile,
+		                std::min(tile, width - tx * tile),
+		                std::min(tile, height - ty * tile));
+	}
+
+	int bandBegin(int block) const { return block * bandblock; }
+	int bandEnd(int block) const
+	{ return std::min(nbands, (block + 1) * bandblock); }
+
+	int width, height, nbands, tile, bandblock;
+	int tilesX, tilesY, blocks;
+};
+
+struct ChunkEntry {
+	uint64_t offset, size;
+	uint32_t codec;
+};
+
+/// appends plain values to a byte buffer
+class Serializer {
+public:
+	template<typename T>
+	void put(const T &value)
+	{
+		const char *p = reinterpret_cast<const char*>(&value);
+		buf.insert(buf.end(), p, p + sizeof(T));
+	}
+
+	std::vector<char> buf;
+};
+
+/// reads plain values from a byte buffer, with bounds checking
+class Deserializer {
+public:
+	Deserializer(const char *begin, const char *end)
+		: cur(begin), end(end), ok(true) {}
+
+	template<typename T>
+	T get()
+	{
+		T value = T();
+		if (!ok || (size_t)(end - cur) < sizeof(T)) {
+			ok = false;
+			return value;
+		}
+		std::memcpy(&value, cur, sizeof(T));
+		cur += sizeof(T);
+		return value;
+	}
+
+	const char *cur, *end;
+	bool ok;
+};
+
+bool CubeFile::isCubeFile(const std::string &file)
+{
+	const std::string ext(Extension);
+	if (file.size() <= ext.size())
+		return false;
+	std::string tail = file.substr(file.size() - ext.size());
+	std::transform(tail.begin(), tail.end(), tail.begin(), ::tolower);
+	return tail == ext;
+}
+
+/// computes min, max and histogram of each band
+class CubeBandStats {
+public:
+	CubeBandStats(const multi_img &img,
+	              std::vector<CubeFile::BandStats> &stats)
+		: img(img), stats(stats) {}
+
+	void operator()(const tbb::blocked_range<size_t> &r) const
+	{
+		const double scale = (img.maxval > img.minval ?
+		            CubeFile::HistBins / (double)(img.maxval - img.minval) : 0.);
+		for (size_t d = r.begin(); d != r.end(); ++d) {
+			CubeFile::BandStats &s = stats[d];
+			s.hist.assign(CubeFile::HistBins, 0);
+			double minv, maxv;
+			cv::minMaxLoc(img[d], &minv, &maxv);
+			s.min = (multi_img::Value)minv;
+			s.max = (multi_img::Value)maxv;
+			multi_img::Band::const_iterator it = img[d].begin();
+			for (; it != img[d].end(); ++it) {
+				int bin = (int)((*it - img.minval) * scale);
+				bin = std::max(0, std::min(CubeFile::HistBins - 1, bin));
+				++s.hist[bin];
+			}
+		}
+	}
+
+private:
+	const multi_img &img;
+	std::vector<CubeFile::BandStats> &stats;
+};
+
+/// copies and compresses the chunks of one band block
+class CubeCompress {
+public:
+	CubeCompress(const multi_img &img, const CubeGeometry &g, int block,
+	             std::vector<std::vector<char> > &data,
+	             std::vector<uint32_t> &codecs)
+		: img(img), g(g), block(block), data(data), codecs(codecs) {}
+
+	void operator()(const tbb::blocked_range<int> &r) const
+	{
+		std::vector<multi_img::Value> raw;
+		for (int i = r.begin(); i != r.end(); ++i) {
+			const cv::Rect t = g.tileRect(i % g.tilesX, i / g.tilesX);
+			const int b0 = g.bandBegin(block), b1 = g.bandEnd(block);
+			raw.resize((size_t)t.area() * (b1 - b0));
+			multi_img::Value *dst = &raw[0];
+			for (int d = b0; d < b1; ++d) {
+				for (int y = t.y; y < t.y + t.height; ++y, dst += t.width) {
+					const multi_img::Value *src = img[d][y] + t.x;
+					std::copy(src, src + t.width, dst);
+				}
+			}
+
+			const char *rawp = reinterpret_cast<const char*>(&raw[0]);
+			const int rawsize = (int)(raw.size() * sizeof(multi_img::Value));
+			std::vector<char> &out = data[i];
+			codecs[i] = CODEC_RAW;
+#ifdef WITH_LZ4
+			out.resize(LZ4_compressBound(rawsize));
+			int size = LZ4_compress_default(rawp, &out[0], rawsize,
+			                                (int)out.size());
+			// keep chunk uncompressed if compression did not help
+			if (size > 0 && size < rawsize) {
+				out.resize(size);
+				codecs[i] = CODEC_LZ4;
+				continue;
+			}
+#endif
+			out.assign(rawp, rawp + rawsize);
+		}
+	}
+
+private:
+	const multi_img &img;
+	const CubeGeometry &g;
+	int block;
+	std::vector<std::vector<char> > &data;
+	std::vector<uint32_t> &codecs;
+};
+
+bool CubeFile::write(const multi_img &img, const std::string &file)
+{
+	if (img.empty())
+		return false;
+
+	const CubeGeometry g(img.width, img.height, (int)img.size(),
+	                     TileSize, BandBlock);
+
+	std::vector<BandStats> stats(img.size());
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, img.size()),
+	                  CubeBandStats(img, stats));
+
+	Serializer header;
+	for (int i = 0; i < 8; ++i)
+		header.put(Magic[i]);
+	header.put(Version);
+	header.put(ByteOrderMark);
+	header.put((uint32_t)sizeof(multi_img::Value));
+	header.put((int32_t)g.width);
+	header.put((int32_t)g.height);
+	header.put((int32_t)g.nbands);
+	header.put((int32_t)g.tile);
+	header.put((int32_t)g.bandblock);
+	header.put((int32_t)HistBins);
+	header.put(img.minval);
+	header.put(img.maxval);
+	for (size_t d = 0; d < img.size(); ++d) {
+		const multi_img::BandDesc &m = img.meta[d];
+		header.put(m.center);
+		header.put(m.rangeStart);
+		header.put(m.rangeEnd);
+		header.put((uint32_t)m.empty);
+		header.put(stats[d].min);
+		header.put(stats[d].max);
+		for (int i = 0; i < HistBins; ++i)
+			header.put((uint32_t)stats[d].hist[i]);
+	}
+	const size_t indexPos = header.buf.size();
+	const size_t entrySize = 2 * sizeof(uint64_t) + sizeof(uint32_t);
+	const size_t dataPos = indexPos + g.chunks() * entrySize;
+
+	std::ofstream out(file.c_str(), std::ios::binary | std::ios::trunc);
+	if (!out) {
+		std::cerr << "Could not open " << file << " for writing" << std::endl;
+		return false;
+	}
+	out.write(&header.buf[0], header.buf.size());
+	// placeholder for the chunk index
+	out.write(std::vector<char>(dataPos - indexPos).data(), dataPos - indexPos);
+
+	/* compress one band block at a time in parallel, to keep only a fraction
+	   of the compressed image in memory */
+	std::vector<ChunkEntry> index(g.chunks());
+	uint64_t offset = dataPos;
+	for (int block = 0; block < g.blocks; ++block) {
+		const int tiles = g.tilesX * g.tilesY;
+		std::vector<std::vector<char> > data(tiles);
+		std::vector<uint32_t> codecs(tiles);
+		tbb::parallel_for(tbb::blocked_range<int>(0, tiles),
+		                  CubeCompress(img, g, block, data, codecs));
+		for (int i = 0; i < tiles; ++i) {
+			ChunkEntry &e = index[g.index(block, i / g.tilesX, i % g.tilesX)];
+			e.offset = offset;
+			e.size = data[i].size();
+			e.codec = codecs[i];
+			out.write(&data[i][0], data[i].size());
+			offset += e.size;
+		}
+	}
+
+	Serializer idx;
+	for (size_t i = 0; i < index.size(); ++i) {
+		idx.put(index[i].offset);
+		idx.put(index[i].size);
+		idx.put(index[i].codec);
+	}
+	out.seekp(indexPos);
+	out.write(&idx.buf[0], idx.buf.size());
+	out.close();
+	if (!out) {
+		std::cerr << "Writing " << file << " failed" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// parsed header of a cube file
+struct CubeHeader {
+	CubeHeader() : g(0, 0, 0, 1, 1) {}
+
+	CubeGeometry g;
+	int histbins;
+	multi_img::Value minval, maxval;
+	std::vector<multi_img::BandDesc> meta;
+	std::vector<CubeFile::BandStats> stats;
+	std::vector<ChunkEntry> index;
+};
+
+static bool parseHeader(const char *begin, size_t size, CubeHeader &h,
+                        const std::string &file)
+{
+	Deserializer in(begin, begin + size);
+	bool magic = true;
+	for (int i = 0; i < 8; ++i)
+		magic = (in.get<char>() == Magic[i]) && magic;
+	if (!in.ok || !magic) {
+		std::cerr << file << " is not a cube file" << std::endl;
+		return false;
+	}
+	uint32_t version = in.get<uint32_t>();
+	uint32_t bom = in.get<uint32_t>();
+	uint32_t valuesize = in.get<uint32_t>();
+	if (version != Version || bom != ByteOrderMark
+	    || valuesize != sizeof(multi_img::Value)) {
+		std::cerr << file << ": unsupported cube file version or byte order"
+		          << std::endl;
+		return false;
+	}
+	int width = in.get<int32_t>(), height = in.get<int32_t>(),
+	    nbands = in.get<int32_t>(), tile = in.get<int32_t>(),
+	    bandblock = in.get<int32_t>();
+	h.histbins = in.get<int32_t>();
+	h.minval = in.get<multi_img::Value>();
+	h.maxval = in.get<multi_img::Value>();
+	if (!in.ok || width < 1 || height < 1 || nbands < 1 || tile < 1
+	    || bandblock < 1 || h.histbins < 0) {
+		std::cerr << file << ": corrupt cube file header" << std::endl;
+		return false;
+	}
+	h.g = CubeGeometry(width, height, nbands, tile, bandblock);
+
+	h.meta.resize(nbands);
+	h.stats.resize(nbands);
+	for (int d = 0; d < nbands && in.ok; ++d) {
+		float center = in.get<float>();
+		float start = in.get<float>();
+		float end = in.get<float>();
+		bool empty = (in.get<uint32_t>() != 0);
+		if (!empty) {
+			h.meta[d] = multi_img::BandDesc(start, end);
+			h.meta[d].center = center;
+		}
+		h.stats[d].min = in.get<multi_img::Value>();
+		h.stats[d].max = in.get<multi_img::Value>();
+		h.stats[d].hist.resize(h.histbins);
+		for (int i = 0; i < h.histbins; ++i)
+			h.stats[d].hist[i] = in.get<uint32_t>();
+	}
+
+	h.index.resize(h.g.chunks());
+	for (size_t i = 0; i < h.index.size() && in.ok; ++i) {
+		ChunkEntry &e = h.index[i];
+		e.offset = in.get<uint64_t>();
+		e.size = in.get<uint64_t>();
+		e.codec = in.get<uint32_t>();
+		if (e.offset > size || e.size > size - e.offset)
+			in.ok = false;
+	}
+	if (!in.ok) {
+		std::cerr << file << ": corrupt cube file header" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/// decompresses chunks and copies their intersection with the ROI
+class CubeDecompress {
+public:
+	CubeDecompress(const char *file, const CubeHeader &h,
+	               const std::vector<size_t> &chunks,
+	               const cv::Rect &roi, int bandlow, int bandhigh,
+	               std::vector<multi_img::Band> &planes,
+	               tbb::atomic<int> &failed)
+		: file(file), h(h), chunks(chunks), roi(roi),
+		  bandlow(bandlow), bandhigh(bandhigh), planes(planes),
+		  failed(failed) {}
+
+	void operator()(const tbb::blocked_range<size_t> &r) const
+	{
+		const CubeGeometry &g = h.g;
+		const size_t tiles = (size_t)g.tilesX * g.tilesY;
+		std::vector<multi_img::Value> raw;
+		for (size_t i = r.begin(); i != r.end(); ++i) {
+			const size_t c = chunks[i];
+			const int block = (int)(c / tiles);
+			const int ty = (int)((c % tiles) / g.tilesX);
+			const int tx = (int)(c % g.tilesX);
+			const cv::Rect t = g.tileRect(tx, ty);
+			const int b0 = g.bandBegin(block), b1 = g.bandEnd(block);
+			raw.resize((size_t)t.area() * (b1 - b0));
+			const int rawsize = (int)(raw.size() * sizeof(multi_img::Value));
+
+			const ChunkEntry &e = h.index[c];
+			const char *src = file + e.offset;
+			char *dst = reinterpret_cast<char*>(&raw[0]);
+			bool ok = false;
+			if (e.codec == CODEC_RAW) {
+				ok = (e.size == (uint64_t)rawsize);
+				if (ok)
+					std::memcpy(dst, src, rawsize);
+#ifdef WITH_LZ4
+			} else if (e.codec == CODEC_LZ4) {
+				ok = (LZ4_decompress_safe(src, dst, (int)e.size, rawsize)
+				      == rawsize);
+#endif
+			}
+			if (!ok) {
+				++failed;
+				continue;
+			}
+
+			// copy intersection of tile and ROI
+			const cv::Rect isect = t & roi;
+			for (int d = std::max(b0, bandlow); d < std::min(b1, bandhigh + 1);
+			     ++d) {
+				const multi_img::Value *plane =
+				        &raw[(size_t)(d - b0) * t.area()];
+				for (int y = isect.y; y < isect.y + isect.height; ++y) {
+					const multi_img::Value *s =
+					        plane + (y - t.y) * t.width + (isect.x - t.x);
+					std::copy(s, s + isect.width,
+					          planes[d - bandlow][y - roi.y] + (isect.x - roi.x));
+				}
+			}
+		}
+	}
+
+private:
+	const char *file;
+	const CubeHeader &h;
+	const std::vector<size_t> &chunks;
+	const cv::Rect roi;
+	int bandlow, bandhigh;
+	std::vector<multi_img::Band> &planes;
+	tbb::atomic<int> &failed;
+};
+
+bool CubeFile::readStats(const std::string &file,
+                         std::vector<BandStats> &stats)
+{
+	try {
+		bip::file_mapping mapping(file.c_str(), bip::read_only);
+		bip::mapped_region region(mapping, bip::read_only);
+		CubeHeader h;
+		if (!parseHeader(static_cast<const char*>(region.get_address()),
+		                 region.get_size(), h, file))
+			return false;
+		stats.swap(h.stats);
+		return true;
+	} catch (const bip::interprocess_exception &e) {
+		std::cerr << "Could not map " << file << ": " << e.what()
+		          << std::endl;
+		return false;
+	}
+}
+
+multi_img::ptr CubeFile::readFile()
+{
+	if (!isCubeFile(config.file))
+		return multi_img::ptr(new multi_img());
+
+	// map whole file, only pages of the chunks we decompress are read
+	bip::mapped_region region;
+	try {
+		bip::file_mapping mapping(config.file.c_str(), bip::read_only);
+		bip::mapped_region(mapping, bip::read_only).swap(region);
+	} catch (const bip::interprocess_exception &e) {
+		std::cerr << "Could not map " << config.file << ": " << e.what()
+		          << std::endl;
+		return multi_img::ptr(new multi_img());
+	}
+	const char *data = static_cast<const char*>(region.get_address());
+
+	CubeHeader h;
+	if (!parseHeader(data, region.get_size(), h, config.file))
+		return multi_img::ptr(new multi_img());
+	const CubeGeometry &g = h.g;
+
+	std::cout << "Reading image: " << config.file << std::endl;
+
+	// find ROI
+	cv::Rect roi(0, 0, g.width, g.height);
+	if (!config.roi.empty()) {
+		std::vector<int> roiVals;
+		if (!ImgInput::parseROIString(config.roi, roiVals)) {
+			std::cerr << "Ignoring invalid ROI specification" << std::endl;
+		} else {
+			cv::Rect r(roiVals[0], roiVals[1], roiVals[2], roiVals[3]);
+			if (r.width < 1 || r.height < 1 || (r & roi) != r) {
+				std::cerr << "ROI exceeds image dimensions!" << std::endl;
+				return multi_img::ptr(new multi_img());
+			}
+			roi = r;
+		}
+	}
+
+	// crop spectrum
+	int bandlow = 0;
+	int bandhigh = g.nbands - 1; // inclusive, just like config.bandhigh
+	if ((config.bandlow > 0) ||
+		(config.bandhigh > 0 && config.bandhigh < g.nbands - 1))
+	{
+		// if bandhigh is not specified, do not limit
+		bandhigh = (config.bandhigh == 0) ? (g.nbands - 1) : config.bandhigh;
+
+		// correct input?
+		if (config.bandlow > bandhigh || bandhigh > g.nbands - 1)
+		{
+			std::cerr << "Inconsistent bandlow, bandhigh values specified!" << std::endl;
+			return multi_img::ptr(new multi_img());
+		}
+		bandlow = config.bandlow;
+	}
+
+	// chunks intersecting ROI and band subrange
+	std::vector<size_t> chunks;
+	for (int block = bandlow / g.bandblock; block <= bandhigh / g.bandblock;
+	     ++block) {
+		for (int ty = roi.y / g.tile; ty <= (roi.br().y - 1) / g.tile; ++ty)
+			for (int tx = roi.x / g.tile; tx <= (roi.br().x - 1) / g.tile; ++tx)
+				chunks.push_back(g.index(block, ty, tx));
+	}
+
+	// create multi_img & decompress straight into its band planes
+	multi_img::ptr img_ptr(new multi_img(roi.height, roi.width,
+	                                     bandhigh - bandlow + 1));
+	std::vector<multi_img::Band> planes(img_ptr->size());
+	for (size_t d = 0; d < planes.size(); ++d)
+		planes[d] = (*img_ptr)[d]; // shares the band's data
+
+	tbb::atomic<int> failed;
+	failed = 0;
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size()),
+	                  CubeDecompress(data, h, chunks, roi, bandlow, bandhigh,
+	                                 planes, failed));
+	if (failed > 0) {
+		std::cerr << config.file << ": " << failed << " chunks could not be "
+		          << "decompressed" << std::endl;
+		return multi_img::ptr(new multi_img());
+	}
+
+	for (int b = bandlow; b <= bandhigh; ++b)
+		img_ptr->meta[b - bandlow] = h.meta[b];
+	img_ptr->minval = h.minval;
+	img_ptr->maxval = h.maxval;
+
+	// invalidate pixel cache as band data was written directly
+	img_ptr->resetPixels();
+
+	return img_ptr;
+}
+
+} //namespace
+
+#endif // WITH_BOOST
@@ -0,0 +1,69 @@
+#ifdef WITH_BOOST
+
+#ifndef CUBEFILE_H
+#define CUBEFILE_H
+
+#include <string>
+#include <vector>
+#include <multi_img.h>
+#include "imginput_config.h"
+
+namespace imginput {
+
+/** Native, tiled and chunk-compressed container for multispectral images.
+
+	The image is split into chunks of TileSize x TileSize pixels times
+	BandBlock bands. Each chunk is stored band-sequential and compressed
+	individually (LZ4, if available at build time, else uncompressed). The
+	header holds the image geometry, minval/maxval, band metadata, per-band
+	minimum, maximum and histogram and an index of all chunks.
+
+	Reading memory-maps the file and only decompresses the chunks that
+	intersect the requested ROI and band subrange, in parallel.
+
+	All values are stored in host byte order; files are rejected on a
+	machine of different endianness.
+ */
+class CubeFile {
+public:
+	CubeFile(const ImgInputConfig& config)
+		: config(config) { }
+
+	/// file name extension of cube files
+	static const char *Extension;
+
+	/// edge length of a chunk's spatial tile
+	static const int TileSize = 128;
+	/// number of bands in a chunk
+	static const int BandBlock = 16;
+	/// number of bins of the per-band histograms, spanning minval..maxval
+	static const int HistBins = 256;
+
+	/// per-band statistics stored in the header
+	struct BandStats {
+		multi_img::Value min, max;
+		std::vector<unsigned int> hist;
+	};
+
+	/// returns true if the file name has the cube file extension
+	static bool isCubeFile(const std::string &file);
+
+	/// write image to cube file, returns false on error
+	static bool write(const multi_img &img, const std::string &file);
+
+	/// read band statistics from the header without touching image data
+	static bool readStats(const std::string &file,
+	                      std::vector<BandStats> &stats);
+
+	/// returns empty image if the file is not a cube file or on error
+	multi_img::ptr readFile();
+
+private:
+	const ImgInputConfig &config;
+};
+
+} // namespace
+
+#endif // CUBEFILE_H
+
+#endif // WITH_BOOST
@@ -0,0 +1,436 @@
+#ifdef WITH_BOOST
+
+#include "imginput.h"
+#include "envireader.h"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+#include <stdint.h>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace bip = boost::interprocess;
+
+namespace imginput {
+
+static std::string trim(const std::string &str)
+{
+	const char *ws = " \t\r\n";
+	std::string::size_type first = str.find_first_not_of(ws);
+	if (first == std::string::npos)
+		return std::string();
+	return str.substr(first, str.find_last_not_of(ws) - first + 1);
+}
+
+static std::string lower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+	return str;
+}
+
+static bool fileExists(const std::string &file)
+{
+	std::ifstream in(file.c_str(), std::ios::binary);
+	return in.good();
+}
+
+static std::vector<float> parseList(const std::string &str)
+{
+	std::vector<float> ret;
+	std::stringstream in(str);
+	std::string item;
+	while (std::getline(in, item, ',')) {
+		float value;
+		if (sscanf(item.c_str(), "%f", &value) == 1)
+			ret.push_back(value);
+	}
+	return ret;
+}
+
+bool EnviReader::findFiles(const std::string &file,
+                           std::string &header, std::string &data)
+{
+	std::string::size_type dot = file.find_last_of('.');
+	std::string::size_type sep = file.find_last_of("/\\");
+	if (dot != std::string::npos && sep != std::string::npos && dot < sep)
+		dot = std::string::npos;
+	std::string base = (dot == std::string::npos ? file : file.substr(0, dot));
+	std::string ext = (dot == std::string::npos ? std::string()
+	                                            : lower(file.substr(dot)));
+
+	if (ext == ".hdr") {
+		// the header was given, look for the raw data next to it
+		header = file;
+		const char *exts[] = { "", ".raw", ".img", ".dat",
+		                       ".bsq", ".bil", ".bip" };
+		for (size_t i = 0; i < sizeof(exts)/sizeof(char*); ++i) {
+			if (fileExists(base + exts[i])) {
+				data = base + exts[i];
+				return true;
+			}
+		}
+		std::cerr << "ENVI header " << file << " found, but no raw data file"
+		          << std::endl;
+		return false;
+	}
+
+	// the raw data was given, header is either file.hdr or base.hdr
+	data = file;
+	if (fileExists(file + ".hdr")) {
+		header = file + ".hdr";
+		return true;
+	}
+	if (dot != std::string::npos && fileExists(base + ".hdr")) {
+		header = base + ".hdr";
+		return true;
+	}
+	return false;
+}
+
+bool EnviReader::parseHeader(const std::string &file, Header &hdr)
+{
+	std::ifstream in(file.c_str());
+	std::string line;
+	if (!std::getline(in, line) || line.compare(0, 4, "ENVI") != 0)
+		return false;
+
+	// read all "key = value" pairs, values in braces may span multiple lines
+	std::map<std::string, std::string> fields;
+	while (std::getline(in, line)) {
+		std::string::size_type eq = line.find('=');
+		if (eq == std::string::npos)
+			continue;
+		std::string key = lower(trim(line.substr(0, eq)));
+		std::string value = trim(line.substr(eq + 1));
+		if (!value.empty() && value[0] == '{') {
+			while (value.find('}') == std::string::npos
+			       && std::getline(in, line))
+				value += " " + line;
+			std::string::size_type end = value.find('}');
+			value = trim(value.substr(1, end == std::string::npos
+			                             ? std::string::npos : end - 1));
+		}
+		fields[key] = value;
+	}
+
+	hdr.samples = atoi(fields["samples"].c_str());
+	hdr.lines = atoi(fields["lines"].c_str());
+	hdr.bands = atoi(fields["bands"].c_str());
+	hdr.offset = (size_t)std::max(0, atoi(fields["header offset"].c_str()));
+	hdr.datatype = atoi(fields["data type"].c_str());
+	hdr.bigendian = (atoi(fields["byte order"].c_str()) == 1);
+
+	std::string interleave = lower(fields["interleave"]);
+	if (interleave == "bil")
+		hdr.interleave = Header::BIL;
+	else if (interleave == "bip")
+		hdr.interleave = Header::BIP;
+	else if (interleave.empty() || interleave == "bsq")
+		hdr.interleave = Header::BSQ;
+	else {
+		std::cerr << "ENVI header " << file << ": unsupported interleave "
+		          << interleave << std::endl;
+		return false;
+	}
+
+	if (hdr.samples < 1 || hdr.lines < 1 || hdr.bands < 1) {
+		std::cerr << "ENVI header " << file << ": invalid image dimensions"
+		          << std::endl;
+		return false;
+	}
+
+	// band metadata, we store wavelengths in nm
+	hdr.wavelength = parseList(fields["wavelength"]);
+	hdr.fwhm = parseList(fields["fwhm"]);
+	std::string units = lower(fields["wavelength units"]);
+	if (units == "micrometers" || units == "um" || units == "microns") {
+		for (size_t i = 0; i < hdr.wavelength.size(); ++i)
+			hdr.wavelength[i] *= 1000.f;
+		for (size_t i = 0; i < hdr.fwhm.size(); ++i)
+			hdr.fwhm[i] *= 1000.f;
+	}
+	return true;
+}
+
+size_t EnviReader::sampleSize(int datatype)
+{
+	switch (datatype) {
+	case 1:  return 1;  // uint8
+	case 2:             // int16
+	case 12: return 2;  // uint16
+	case 3:             // int32
+	case 13:            // uint32
+	case 4:  return 4;  // float32
+	case 5:  return 8;  // float64
+	default: return 0;
+	}
+}
+
+static bool hostBigEndian()
+{
+	const uint16_t one = 1;
+	return *(const unsigned char*)&one == 0;
+}
+
+/* Converts the raw samples of a window of the image into band planes.
+   The source is addressed by strides (in samples) for band, line and pixel,
+   relative to the first sample of the window. Negative values are clamped
+   and the maximum value is determined on the fly. */
+template<typename T>
+class EnviConvert {
+public:
+	EnviConvert(const unsigned char *data, bool swap,
+	            size_t bstride, size_t lstride, size_t sstride,
+	            std::vector<multi_img::Band> &planes)
+		: maxval(0.), data(data), swap(swap), bstride(bstride),
+		  lstride(lstride), sstride(sstride), planes(planes) {}
+
+	EnviConvert(EnviConvert &other, tbb::split)
+		: maxval(0.), data(other.data), swap(other.swap),
+		  bstride(other.bstride), lstride(other.lstride),
+		  sstride(other.sstride), planes(other.planes) {}
+
+	void operator()(const tbb::blocked_range<int> &r)
+	{
+		const int width = planes[0].cols;
+		const size_t nbands = planes.size();
+		for (int y = r.begin(); y != r.end(); ++y) {
+			const unsigned char *line = data + y * lstride * sizeof(T);
+			if (sstride < bstride) {
+				// BSQ, BIL: each band row is contiguous
+				for (size_t d = 0; d < nbands; ++d) {
+					const unsigned char *src = line + d * bstride * sizeof(T);
+					multi_img::Value *dst = planes[d][y];
+					for (int x = 0; x < width; ++x, src += sizeof(T))
+						dst[x] = convert(src);
+				}
+			} else {
+				// BIP: each pixel is contiguous
+				for (int x = 0; x < width; ++x) {
+					const unsigned char *src = line + x * sstride * sizeof(T);
+					for (size_t d = 0; d < nbands; ++d, src += sizeof(T))
+						planes[d](y, x) = convert(src);
+				}
+			}
+		}
+	}
+
+	void join(EnviConvert &other)
+	{
+		maxval = std::max(maxval, other.maxval);
+	}
+
+	/// maximum value encountered
+	double maxval;
+
+private:
+	inline multi_img::Value convert(const unsigned char *src)
+	{
+		T v;
+		if (swap) {
+			unsigned char buf[sizeof(T)];
+			std::reverse_copy(src, src + sizeof(T), buf);
+			std::memcpy(&v, buf, sizeof(T));
+		} else {
+			std::memcpy(&v, src, sizeof(T));
+		}
+		double value = std::max((double)v, 0.);
+		if (value > maxval)
+			maxval = value;
+		return (multi_img::Value)value;
+	}
+
+	const unsigned char *data;
+	bool swap;
+	size_t bstride, lstride, sstride;
+	std::vector<multi_img::Band> &planes;
+};
+
+template<typename T>
+static double convert(const unsigned char *data, bool swap,
+                      size_t bstride, size_t lstride, size_t sstride,
+                      std::vector<multi_img::Band> &planes)
+{
+	EnviConvert<T> conv(data, swap, bstride, lstride, sstride, planes);
+	tbb::parallel_reduce(tbb::blocked_range<int>(0, planes[0].rows), conv);
+	return conv.maxval;
+}
+
+multi_img::ptr EnviReader::readFile()
+{
+	std::string hdrfile, datafile;
+	Header hdr;
+	if (!findFiles(config.file, hdrfile, datafile)
+	    || !parseHeader(hdrfile, hdr))
+		return multi_img::ptr(new multi_img());
+
+	const size_t bytes = sampleSize(hdr.datatype);
+	if (bytes == 0) {
+		std::cerr << "ENVI header " << hdrfile << ": unsupported data type "
+		          << hdr.datatype << std::endl;
+		return multi_img::ptr(new multi_img());
+	}
+
+	std::cout << "Reading image: " << datafile << std::endl;
+
+	// find ROI
+	cv::Rect roi(0, 0, hdr.samples, hdr.lines);
+	if (!config.roi.empty()) {
+		std::vector<int> roiVals;
+		if (!ImgInput::parseROIString(config.roi, roiVals)) {
+			std::cerr << "Ignoring invalid ROI specification" << std::endl;
+		} else {
+			cv::Rect r(roiVals[0], roiVals[1], roiVals[2], roiVals[3]);
+			if (r.width < 1 || r.height < 1 || (r & roi) != r) {
+				std::cerr << "ROI exceeds image dimensions!" << std::endl;
+				return multi_img::ptr(new multi_img());
+			}
+			roi = r;
+		}
+	}
+
+	// crop spectrum
+	int bandlow = 0;
+	int bandhigh = hdr.bands - 1; // inclusive, just like config.bandhigh
+	if ((config.bandlow > 0) ||
+		(config.bandhigh > 0 && config.bandhigh < hdr.bands - 1))
+	{
+		// if bandhigh is not specified, do not limit
+		bandhigh = (config.bandhigh == 0) ? (hdr.bands - 1) : config.bandhigh;
+
+		// correct input?
+		if (config.bandlow > bandhigh || bandhigh > hdr.bands - 1)
+		{
+			std::cerr << "Inconsistent bandlow, bandhigh values specified!" << std::endl;
+			return multi_img::ptr(new multi_img());
+		}
+		bandlow = config.bandlow;
+	}
+
+	// strides in samples
+	size_t bstride, lstride, sstride;
+	switch (hdr.interleave) {
+	case Header::BIL:
+		sstride = 1;
+		bstride = hdr.samples;
+		lstride = (size_t)hdr.samples * hdr.bands;
+		break;
+	case Header::BIP:
+		bstride = 1;
+		sstride = hdr.bands;
+		lstride = (size_t)hdr.samples * hdr.bands;
+		break;
+	default:
+		sstride = 1;
+		lstride = hdr.samples;
+		bstride = (size_t)hdr.samples * hdr.lines;
+	}
+
+	/* byte range holding our window. The sample index is monotonic in band,
+	   line and pixel, so the first and last sample of the window bound it. */
+	const size_t first = hdr.offset + bytes *
+	        (bandlow * bstride + roi.y * lstride + roi.x * sstride);
+	const size_t last = hdr.offset + bytes *
+	        (bandhigh * bstride + (roi.br().y - 1) * lstride
+	         + (roi.br().x - 1) * sstride + 1);
+
+	std::ifstream in(datafile.c_str(), std::ios::binary | std::ios::ate);
+	const std::streamoff filesize = in.tellg();
+	in.close();
+	const size_t expected = hdr.offset +
+	        bytes * (size_t)hdr.samples * hdr.lines * hdr.bands;
+	if (filesize < 0 || (size_t)filesize < expected) {
+		std::cerr << "ENVI raw file " << datafile << " is too small, expected "
+		          << expected << " bytes" << std::endl;
+		return multi_img::ptr(new multi_img());
+	}
+
+	// map only the needed part of the file, pages are read on first access
+	bip::mapped_region region;
+	try {
+		bip::file_mapping file(datafile.c_str(), bip::read_only);
+		bip::mapped_region(file, bip::read_only,
+		                   (bip::offset_t)first, last - first).swap(region);
+	} catch (const bip::interprocess_exception &e) {
+		std::cerr << "Could not map " << datafile << ": " << e.what()
+		          << std::endl;
+		return multi_img::ptr(new multi_img());
+	}
+	const unsigned char *data =
+	        static_cast<const unsigned char*>(region.get_address());
+
+	// create multi_img & convert straight into its band planes
+	multi_img::ptr img_ptr(new multi_img(roi.height, roi.width,
+	                                     bandhigh - bandlow + 1));
+	std::vector<multi_img::Band> planes(img_ptr->size());
+	for (size_t d = 0; d < planes.size(); ++d)
+		planes[d] = (*img_ptr)[d]; // shares the band's data
+
+	const bool swap = (hdr.bigendian != hostBigEndian());
+	double maxVal = 0.;
+	switch (hdr.datatype) {
+	case 1:
+		maxVal = convert<uint8_t>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 2:
+		maxVal = convert<int16_t>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 3:
+		maxVal = convert<int32_t>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 4:
+		maxVal = convert<float>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 5:
+		maxVal = convert<double>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 12:
+		maxVal = convert<uint16_t>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	case 13:
+		maxVal = convert<uint32_t>(data, swap, bstride, lstride, sstride, planes);
+		break;
+	}
+
+	// band metadata
+	if ((int)hdr.wavelength.size() == hdr.bands) {
+		bool haveFwhm = ((int)hdr.fwhm.size() == hdr.bands);
+		for (int b = bandlow; b <= bandhigh; ++b) {
+			float c = hdr.wavelength[b];
+			if (haveFwhm && hdr.fwhm[b] > 0.f)
+				img_ptr->meta[b - bandlow] =
+				        multi_img::BandDesc(c - hdr.fwhm[b] * 0.5f,
+				                            c + hdr.fwhm[b] * 0.5f);
+			else
+				img_ptr->meta[b - bandlow] = multi_img::BandDesc(c);
+		}
+	}
+
+	/* if our image data has more than 8 bit (values > 255), then
+	 * determine dynamic range of camera (we assume it is a power of two) */
+	double powMax = 256;
+	for (; powMax < maxVal; powMax *= 2) {
+		// nothing
+	}
+
+	// set min & max
+	img_ptr->minval = 0;
+	img_ptr->maxval = (multi_img::Value)powMax;
+
+	// invalidate pixel cache as band data was written directly
+	img_ptr->resetPixels();
+
+	return img_ptr;
+}
+
+} //namespace
+
+#endif // WITH_BOOST
@@ -0,0 +1,63 @@
+#ifdef WITH_BOOST
+
+#ifndef ENVIREADER_H
+#define ENVIREADER_H
+
+#include <string>
+#include <vector>
+#include <multi_img.h>
+#include "imginput.h"
+#include "imginput_config.h"
+
+namespace imginput {
+
+/** Native reader for ENVI raw images (BSQ, BIL or BIP interleave).
+
+	The raw file is memory-mapped and only the requested ROI and band subrange
+	(see ImgInputConfig) are converted, directly into the band planes of the
+	resulting image. Pages outside of the requested window are never touched.
+	Supported data types are 8/16/32 bit integers and 32/64 bit floats, in
+	either byte order.
+ */
+class EnviReader {
+public:
+	EnviReader(const ImgInputConfig& config)
+		: config(config) { }
+
+	/// returns empty image if the file is not an ENVI image or on error
+	multi_img::ptr readFile();
+
+	/// parsed ENVI header
+	struct Header {
+		Header() : samples(0), lines(0), bands(0), offset(0), datatype(0),
+		           interleave(BSQ), bigendian(false) {}
+
+		enum Interleave { BSQ, BIL, BIP };
+
+		int samples, lines, bands;
+		size_t offset;
+		int datatype;
+		Interleave interleave;
+		bool bigendian;
+		std::vector<float> wavelength, fwhm;
+	};
+
+private:
+	const ImgInputConfig &config;
+
+	/// find header and raw data file belonging to config.file
+	static bool findFiles(const std::string &file,
+	                      std::string &header, std::string &data);
+
+	/// parse ENVI header file, returns false if it is not an ENVI header
+	static bool parseHeader(const std::string &file, Header &hdr);
+
+	/// size of one sample in bytes, 0 if data type is not supported
+	static size_t sampleSize(int datatype);
+};
+
+} // namespace
+
+#endif // ENVIREADER_H
+
+#endif // WITH_BOOST
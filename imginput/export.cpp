@@ -1,11 +1,16 @@
 #include "export.h"
 #include "imginput.h"
+#include "cubefile.h"
 
 namespace imginput {
 
 int Export::execute()
 {
 	auto image = imginput::ImgInput(config).execute();
+#ifdef WITH_BOOST
+	if (CubeFile::isCubeFile(config.output))
+		return (CubeFile::write(*image, config.output) ? 0 : 1);
+#endif
 	image->write_out(config.output);
 	return 0; // success
 }
@@ -16,7 +21,10 @@ void Export::printShortHelp() const {
 
 void Export::printHelp() const {
 	std::cout << "The output consists of a text file and directory of same name\n"
-	             "that holds each band in a PNG file.";
+	             "that holds each band in a PNG file.\n"
+	             "If the output filename ends in .gcube, a single tiled and\n"
+	             "chunk-compressed cube file is written instead, which loads\n"
+	             "much faster and supports partial reads of ROI and bands.";
 	std::cout << std::endl;
 }
 
@@ -1,5 +1,7 @@
 #include "imginput.h"
 #include "gdalreader.h"
+#include "envireader.h"
+#include "cubefile.h"
 #include <multi_img/illuminant.h>
 #include <string>
 #include <vector>
@@ -19,13 +21,22 @@ multi_img::ptr ImgInput::execute()
 	bool bandsCropped = false;
 
 	multi_img::ptr img_ptr;
-	// try GDAL first as it is better for some formats OpenCV reads, too (e.g. TIFF)
+	/* try native cube and ENVI readers first, they only read the ROI and
+	   band subrange that was asked for */
+#ifdef WITH_BOOST
+	if (CubeFile::isCubeFile(config.file))
+		img_ptr = CubeFile(config).readFile();
+	else
+		img_ptr = EnviReader(config).readFile();
+#endif
+	// try GDAL next as it is better for some formats OpenCV reads, too (e.g. TIFF)
 #ifdef WITH_GDAL
-	img_ptr = GdalReader(config).readFile();
+	if (!img_ptr || img_ptr->empty())
+		img_ptr = GdalReader(config).readFile();
 #endif
 	
 	if (img_ptr && !img_ptr->empty()) {
-		// GdalReader was used successfully, applied roiChanges & bandCropping
+		// a native reader or GdalReader was used successfully, applied roiChanges & bandCropping
 		roiChanged = true;
 		bandsCropped = true;
 	} else {
@@ -164,7 +164,7 @@ MeanShift::Result MeanShiftSP::execute(multi_img::ptr input, multi_img::ptr inpu
 
 		// sum up all superpixel members
 		for (int i = 0; i < N; ++i) {
-			const multi_img::Pixel &s = in->atIndex((*mit)[i]);
+			multi_img::PixelView s = in->atIndex((*mit)[i]);
 			for (int d = 0; d < D; ++d)
 				p[d] += s[d];
 		}